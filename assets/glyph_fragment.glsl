@@ -2,9 +2,11 @@
 layout (location = 0) out vec4 fragment_color;
 layout (location = 0) in vec4 passed_color;
 layout (location = 1) in vec2 passed_texture_coordinates;
+layout (location = 3) in flat int passed_texture_layer;
 
-uniform sampler2D uniform_glyph_atlas;
+layout (binding = 0) uniform sampler2DArray uniform_glyph_atlas;
 
 void main() {
-    fragment_color = passed_color * vec4(1.0, 1.0, 1.0, texture(uniform_glyph_atlas, passed_texture_coordinates).a);
+    vec3 coordinates = vec3(passed_texture_coordinates, float(passed_texture_layer));
+    fragment_color = passed_color * vec4(1.0, 1.0, 1.0, texture(uniform_glyph_atlas, coordinates).a);
 }
@@ -0,0 +1,21 @@
+#version 450 core
+layout (location = 0) in vec2 attrib_corner;
+layout (location = 1) in vec2 attrib_position;
+layout (location = 2) in vec2 attrib_size;
+layout (location = 3) in vec4 attrib_color;
+layout (location = 4) in vec4 attrib_texture_rect;
+layout (location = 5) in ivec2 attrib_texture;
+
+layout (location = 0) out vec4 passed_color;
+layout (location = 1) out vec2 passed_texture_coordinates;
+layout (location = 2) out flat int passed_texture_index;
+layout (location = 3) out flat int passed_texture_layer;
+
+void main() {
+    gl_Position = frame_view_projection * vec4(attrib_position + attrib_corner * attrib_size, 0.0, 1.0);
+    gl_Position.z = draw_depth();
+    passed_color = attrib_color;
+    passed_texture_coordinates = attrib_texture_rect.xy + attrib_corner * attrib_texture_rect.zw;
+    passed_texture_index = attrib_texture.x;
+    passed_texture_layer = attrib_texture.y;
+}
@@ -0,0 +1,30 @@
+#ifdef VERTEX_SHADER
+#extension GL_ARB_shader_draw_parameters : enable
+#endif
+
+layout (std140, binding = 0) uniform FrameData {
+    mat4 frame_view_projection;
+    vec2 frame_viewport;
+    float frame_time;
+};
+
+#ifdef VERTEX_SHADER
+layout (std430, binding = 1) readonly buffer DrawData {
+    uint draw_layers[];
+};
+
+layout (std140, binding = 1) uniform BatchData {
+    uint batch_draw_offset;
+    uint batch_depth_base;
+};
+
+float draw_depth() {
+#ifdef GL_ARB_shader_draw_parameters
+    uint depth = batch_depth_base + draw_layers[batch_draw_offset + gl_DrawIDARB];
+#else
+    uint depth = batch_depth_base + draw_layers[batch_draw_offset];
+#endif
+    // The renderer defines the number of depths, which it spreads across the layers
+    return 1.0 - float(depth + 1u) / float(DEPTH_COUNT + 1u);
+}
+#endif
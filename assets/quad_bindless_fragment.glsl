@@ -0,0 +1,28 @@
+#version 450 core
+#extension GL_ARB_bindless_texture : require
+layout (location = 0) out vec4 fragment_color;
+layout (location = 0) in vec4 passed_color;
+layout (location = 1) in vec2 passed_texture_coordinates;
+layout (location = 2) in flat int passed_texture_index;
+layout (location = 3) in flat int passed_texture_layer;
+
+#ifdef TEXTURED
+layout (std430, binding = 0) readonly buffer TextureHandles {
+    uvec2 texture_handles[];
+};
+#endif
+
+void main() {
+#ifdef TEXTURED
+    vec4 texture_color = vec4(1.0);
+    if (passed_texture_layer != -1) {
+        vec3 coordinates = vec3(passed_texture_coordinates, float(passed_texture_layer));
+        texture_color = texture(sampler2DArray(texture_handles[passed_texture_index]), coordinates);
+    } else if (passed_texture_index != -1) {
+        texture_color = texture(sampler2D(texture_handles[passed_texture_index]), passed_texture_coordinates);
+    }
+    fragment_color = passed_color * texture_color;
+#else
+    fragment_color = passed_color;
+#endif
+}
@@ -3,13 +3,24 @@ layout (location = 0) out vec4 fragment_color;
 layout (location = 0) in vec4 passed_color;
 layout (location = 1) in vec2 passed_texture_coordinates;
 layout (location = 2) in flat int passed_texture_index;
+layout (location = 3) in flat int passed_texture_layer;
 
-uniform sampler2D uniform_textures[32];
+#ifdef TEXTURED
+layout (binding = 1) uniform sampler2D uniform_textures[24];
+layout (binding = 25) uniform sampler2DArray uniform_texture_arrays[8];
+#endif
 
 void main() {
+#ifdef TEXTURED
     vec4 texture_color = vec4(1.0);
-    if (passed_texture_index != -1) {
+    if (passed_texture_layer != -1) {
+        vec3 coordinates = vec3(passed_texture_coordinates, float(passed_texture_layer));
+        texture_color = texture(uniform_texture_arrays[passed_texture_index], coordinates);
+    } else if (passed_texture_index != -1) {
         texture_color = texture(uniform_textures[passed_texture_index], passed_texture_coordinates);
     }
     fragment_color = passed_color * texture_color;
+#else
+    fragment_color = passed_color;
+#endif
 }
@@ -2,17 +2,18 @@
 layout (location = 0) in vec2 attrib_position;
 layout (location = 1) in vec4 attrib_color;
 layout (location = 2) in vec2 attrib_texture_coordinates;
-layout (location = 3) in int attrib_texture_index;
+layout (location = 3) in ivec2 attrib_texture;
 
 layout (location = 0) out vec4 passed_color;
 layout (location = 1) out vec2 passed_texture_coordinates;
 layout (location = 2) out flat int passed_texture_index;
-
-uniform mat4 uniform_transform;
+layout (location = 3) out flat int passed_texture_layer;
 
 void main() {
-    gl_Position = uniform_transform * vec4(attrib_position, 0.0, 1.0);
+    gl_Position = frame_view_projection * vec4(attrib_position, 0.0, 1.0);
+    gl_Position.z = draw_depth();
     passed_color = attrib_color;
     passed_texture_coordinates = attrib_texture_coordinates;
-    passed_texture_index = attrib_texture_index;
+    passed_texture_index = attrib_texture.x;
+    passed_texture_layer = attrib_texture.y;
 }
@@ -266,6 +266,9 @@ int GLAD_GL_VERSION_4_2 = 0;
 int GLAD_GL_VERSION_4_3 = 0;
 int GLAD_GL_VERSION_4_4 = 0;
 int GLAD_GL_VERSION_4_5 = 0;
+int GLAD_GL_ARB_bindless_texture = 0;
+int GLAD_GL_ARB_shader_draw_parameters = 0;
+int GLAD_GL_KHR_parallel_shader_compile = 0;
 PFNGLACCUMPROC glad_glAccum = NULL;
 PFNGLACTIVESHADERPROGRAMPROC glad_glActiveShaderProgram = NULL;
 PFNGLACTIVETEXTUREPROC glad_glActiveTexture = NULL;
@@ -1310,6 +1313,23 @@ PFNGLWINDOWPOS3IPROC glad_glWindowPos3i = NULL;
 PFNGLWINDOWPOS3IVPROC glad_glWindowPos3iv = NULL;
 PFNGLWINDOWPOS3SPROC glad_glWindowPos3s = NULL;
 PFNGLWINDOWPOS3SVPROC glad_glWindowPos3sv = NULL;
+PFNGLGETTEXTUREHANDLEARBPROC glad_glGetTextureHandleARB = NULL;
+PFNGLGETTEXTURESAMPLERHANDLEARBPROC glad_glGetTextureSamplerHandleARB = NULL;
+PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glad_glMakeTextureHandleResidentARB = NULL;
+PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC glad_glMakeTextureHandleNonResidentARB = NULL;
+PFNGLGETIMAGEHANDLEARBPROC glad_glGetImageHandleARB = NULL;
+PFNGLMAKEIMAGEHANDLERESIDENTARBPROC glad_glMakeImageHandleResidentARB = NULL;
+PFNGLMAKEIMAGEHANDLENONRESIDENTARBPROC glad_glMakeImageHandleNonResidentARB = NULL;
+PFNGLUNIFORMHANDLEUI64ARBPROC glad_glUniformHandleui64ARB = NULL;
+PFNGLUNIFORMHANDLEUI64VARBPROC glad_glUniformHandleui64vARB = NULL;
+PFNGLPROGRAMUNIFORMHANDLEUI64ARBPROC glad_glProgramUniformHandleui64ARB = NULL;
+PFNGLPROGRAMUNIFORMHANDLEUI64VARBPROC glad_glProgramUniformHandleui64vARB = NULL;
+PFNGLISTEXTUREHANDLERESIDENTARBPROC glad_glIsTextureHandleResidentARB = NULL;
+PFNGLISIMAGEHANDLERESIDENTARBPROC glad_glIsImageHandleResidentARB = NULL;
+PFNGLVERTEXATTRIBL1UI64ARBPROC glad_glVertexAttribL1ui64ARB = NULL;
+PFNGLVERTEXATTRIBL1UI64VARBPROC glad_glVertexAttribL1ui64vARB = NULL;
+PFNGLGETVERTEXATTRIBLUI64VARBPROC glad_glGetVertexAttribLui64vARB = NULL;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR = NULL;
 static void load_GL_VERSION_1_0(GLADloadproc load) {
     if (!GLAD_GL_VERSION_1_0)
         return;
@@ -2454,10 +2474,37 @@ static void load_GL_VERSION_4_5(GLADloadproc load) {
     glad_glGetnMinmax = (PFNGLGETNMINMAXPROC) load("glGetnMinmax");
     glad_glTextureBarrier = (PFNGLTEXTUREBARRIERPROC) load("glTextureBarrier");
 }
+static void load_GL_ARB_bindless_texture(GLADloadproc load) {
+    if (!GLAD_GL_ARB_bindless_texture)
+        return;
+    glad_glGetTextureHandleARB = (PFNGLGETTEXTUREHANDLEARBPROC) load("glGetTextureHandleARB");
+    glad_glGetTextureSamplerHandleARB = (PFNGLGETTEXTURESAMPLERHANDLEARBPROC) load("glGetTextureSamplerHandleARB");
+    glad_glMakeTextureHandleResidentARB = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC) load("glMakeTextureHandleResidentARB");
+    glad_glMakeTextureHandleNonResidentARB = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC) load("glMakeTextureHandleNonResidentARB");
+    glad_glGetImageHandleARB = (PFNGLGETIMAGEHANDLEARBPROC) load("glGetImageHandleARB");
+    glad_glMakeImageHandleResidentARB = (PFNGLMAKEIMAGEHANDLERESIDENTARBPROC) load("glMakeImageHandleResidentARB");
+    glad_glMakeImageHandleNonResidentARB = (PFNGLMAKEIMAGEHANDLENONRESIDENTARBPROC) load("glMakeImageHandleNonResidentARB");
+    glad_glUniformHandleui64ARB = (PFNGLUNIFORMHANDLEUI64ARBPROC) load("glUniformHandleui64ARB");
+    glad_glUniformHandleui64vARB = (PFNGLUNIFORMHANDLEUI64VARBPROC) load("glUniformHandleui64vARB");
+    glad_glProgramUniformHandleui64ARB = (PFNGLPROGRAMUNIFORMHANDLEUI64ARBPROC) load("glProgramUniformHandleui64ARB");
+    glad_glProgramUniformHandleui64vARB = (PFNGLPROGRAMUNIFORMHANDLEUI64VARBPROC) load("glProgramUniformHandleui64vARB");
+    glad_glIsTextureHandleResidentARB = (PFNGLISTEXTUREHANDLERESIDENTARBPROC) load("glIsTextureHandleResidentARB");
+    glad_glIsImageHandleResidentARB = (PFNGLISIMAGEHANDLERESIDENTARBPROC) load("glIsImageHandleResidentARB");
+    glad_glVertexAttribL1ui64ARB = (PFNGLVERTEXATTRIBL1UI64ARBPROC) load("glVertexAttribL1ui64ARB");
+    glad_glVertexAttribL1ui64vARB = (PFNGLVERTEXATTRIBL1UI64VARBPROC) load("glVertexAttribL1ui64vARB");
+    glad_glGetVertexAttribLui64vARB = (PFNGLGETVERTEXATTRIBLUI64VARBPROC) load("glGetVertexAttribLui64vARB");
+}
+static void load_GL_KHR_parallel_shader_compile(GLADloadproc load) {
+    if (!GLAD_GL_KHR_parallel_shader_compile)
+        return;
+    glad_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) load("glMaxShaderCompilerThreadsKHR");
+}
 static int find_extensionsGL(void) {
     if (!get_exts())
         return 0;
-    (void) &has_ext;
+    GLAD_GL_ARB_bindless_texture = has_ext("GL_ARB_bindless_texture");
+    GLAD_GL_ARB_shader_draw_parameters = has_ext("GL_ARB_shader_draw_parameters");
+    GLAD_GL_KHR_parallel_shader_compile = has_ext("GL_KHR_parallel_shader_compile");
     free_exts();
     return 1;
 }
@@ -2550,5 +2597,7 @@ int gladLoadGLLoader(GLADloadproc load) {
 
     if (!find_extensionsGL())
         return 0;
+    load_GL_ARB_bindless_texture(load);
+    load_GL_KHR_parallel_shader_compile(load);
     return GLVersion.major != 0 || GLVersion.minor != 0;
 }
@@ -0,0 +1,467 @@
+//
+//  MIT License
+//
+//  Copyright (c) 2024 unique-ones
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+
+#include "engine/job.h"
+#include "engine/renderer.h"
+#include "engine/shader.h"
+#include "engine/window.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/// The number of heap allocations made so far, which shows that hot paths do not allocate
+std::atomic<u64> allocations{ 0 };
+
+void *operator new(usize size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto *memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, usize) noexcept {
+    std::free(memory);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Results are accumulated into the sink, such that the compiler cannot optimize the measured work away
+volatile u64 sink = 0;
+
+/// Runs the function repeatedly and retrieves the fastest run in milliseconds, which is the least disturbed one
+template<typename F>
+f64 measure(u32 runs, F &&function) {
+    auto best = std::numeric_limits<f64>::max();
+    for (u32 run = 0; run < runs; ++run) {
+        auto start = Clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<f64, std::milli>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+/// Generates extents of quads that are scattered across the specified bounds, the sequence is the same on every run
+std::vector<QuadExtent> random_extents(usize count, const glm::vec2 &bounds) {
+    std::mt19937 generator{ 42 };
+    std::uniform_real_distribution<f32> x{ 0.0f, bounds.x };
+    std::uniform_real_distribution<f32> y{ 0.0f, bounds.y };
+    std::uniform_real_distribution<f32> size{ 4.0f, 64.0f };
+    std::vector<QuadExtent> extents(count);
+    for (auto &extent : extents) {
+        extent.position = { x(generator), y(generator) };
+        extent.size = { size(generator), size(generator) };
+    }
+    return extents;
+}
+
+/// Generates colors, every fourth of which is translucent
+std::vector<glm::vec4> random_colors(usize count) {
+    std::mt19937 generator{ 7 };
+    std::uniform_real_distribution<f32> channel{ 0.0f, 1.0f };
+    std::vector<glm::vec4> colors(count);
+    for (usize i = 0; i < count; ++i) {
+        colors[i] = { channel(generator), channel(generator), channel(generator), i % 4 == 0 ? 0.5f : 1.0f };
+    }
+    return colors;
+}
+
+/// Creates a command buffer that culls against the specified bounds, like the ones the renderer hands out
+std::unique_ptr<CommandBuffer> command_buffer(const glm::vec2 &bounds) {
+    auto commands = std::make_unique<CommandBuffer>();
+    commands->bounds = { 0.0f, 0.0f, bounds.x, bounds.y };
+    return commands;
+}
+
+/// The vertex layout before its attributes were packed, a float2 position, float4 color, float2 texture coordinates
+/// and an int texture index and layer
+struct UnpackedVertex {
+    glm::vec2 position;
+    glm::vec4 color;
+    glm::vec2 texture_coordinates;
+    s32 texture_index;
+    s32 texture_layer;
+};
+
+/// Compares the size of the vertex stream of a frame with packed and unpacked vertex attributes, the stream is copied
+/// as a whole, which is what uploading it into the mapped ring buffer costs
+void bench_vertex_layout() {
+    constexpr usize QUADS = 1 << 20;
+    std::printf("\n[bench] Vertex layout, %zu quads per frame\n", QUADS);
+
+    // Vertex mode streams four vertices per quad, instanced mode a single instance
+    auto stream = [&](auto vertex, usize per_quad, const char *name) {
+        using T = decltype(vertex);
+        std::vector<T> source(QUADS * per_quad, vertex);
+        std::vector<T> target(QUADS * per_quad);
+        auto time = measure(10, [&] {
+            std::memcpy(target.data(), source.data(), source.size() * sizeof(T));
+            sink = sink + static_cast<u64>(target[QUADS].position.x);
+        });
+        auto bytes = static_cast<f64>(source.size() * sizeof(T));
+        std::printf("[bench]   %-10s %3zu bytes per quad, %7.2f MiB per frame, %7.3f ms, %6.2f GiB/s\n", name,
+                    sizeof(T) * per_quad, bytes / (1 << 20), time, bytes / (1 << 30) / (time / 1000.0));
+    };
+    stream(UnpackedVertex{ { 1.0f, 2.0f }, glm::vec4{ 1.0f }, { 0.0f, 1.0f }, -1, -1 }, 4, "unpacked");
+    stream(Vertex{ { 1.0f, 2.0f }, glm::u8vec4{ 0xFF }, glm::u16vec2{ 0, 0xFFFF }, -1, -1 }, 4, "packed");
+    stream(Instance{ { 1.0f, 2.0f }, { 8.0f, 8.0f }, glm::u8vec4{ 0xFF }, glm::u16vec4{ 0xFFFF }, -1, -1 }, 1,
+           "instanced");
+}
+
+/// Records the same quads and sprites one by one and in batches, batches cull and pack several of them at a time
+void bench_quad_recording() {
+    const glm::vec2 bounds{ 1920.0f, 1080.0f };
+    std::printf("\n[bench] Quad and sprite recording, per call against batched\n");
+    for (usize count : { 10'000, 100'000, 1'000'000 }) {
+        auto extents = random_extents(count, bounds * 1.25f);
+        auto colors = random_colors(count);
+        auto commands = command_buffer(bounds);
+        commands->keys.reserve(count);
+        commands->quads.reserve(count);
+        commands->sprites.reserve(count);
+
+        auto single = measure(5, [&] {
+            commands->clear();
+            for (usize i = 0; i < count; ++i) {
+                commands->draw_quad(extents[i], colors[i]);
+            }
+        });
+        auto batched = measure(5, [&] {
+            commands->clear();
+            commands->draw_quads(extents, colors);
+        });
+        std::printf("[bench]   %8zu quads:   %8.3f ms per call, %8.3f ms batched, %5.2fx\n", count, single, batched,
+                    single / batched);
+
+        std::vector<SpriteExtent> sprites(count);
+        for (usize i = 0; i < count; ++i) {
+            sprites[i] = { extents[i].position, extents[i].size, static_cast<f32>(i) * 0.01f, { 0.5f, 0.5f } };
+        }
+        single = measure(5, [&] {
+            commands->clear();
+            for (usize i = 0; i < count; ++i) {
+                commands->draw_sprite(sprites[i], colors[i]);
+            }
+        });
+        batched = measure(5, [&] {
+            commands->clear();
+            commands->draw_sprites(sprites, colors);
+        });
+        std::printf("[bench]   %8zu sprites: %8.3f ms per call, %8.3f ms batched, %5.2fx\n", count, single, batched,
+                    single / batched);
+    }
+}
+
+/// Records the quads of a frame into one command buffer per thread, which needs no locking at all
+void bench_parallel_recording() {
+    constexpr usize QUADS = 1 << 20;
+    const glm::vec2 bounds{ 1920.0f, 1080.0f };
+    auto extents = random_extents(QUADS, bounds);
+    auto colors = random_colors(QUADS);
+    auto hardware = std::max(std::thread::hardware_concurrency(), 1u);
+    std::printf("\n[bench] Parallel command recording, %zu quads per frame, %u hardware threads\n", QUADS, hardware);
+
+    f64 baseline = 0.0;
+    for (u32 threads = 1; threads <= hardware; threads *= 2) {
+        JobSystem jobs{ threads - 1 };
+        std::vector<std::unique_ptr<CommandBuffer>> buffers;
+        for (u32 i = 0; i < threads; ++i) {
+            buffers.push_back(command_buffer(bounds));
+        }
+
+        auto slice = QUADS / threads;
+        auto time = measure(5, [&] {
+            jobs.parallel_for(threads, 1, [&](u32 begin, u32 end) {
+                for (auto thread = begin; thread < end; ++thread) {
+                    auto &commands = *buffers[thread];
+                    commands.clear();
+                    for (auto i = thread * slice; i < (thread + 1) * slice; ++i) {
+                        commands.draw_quad(extents[i], colors[i]);
+                    }
+                }
+            });
+        });
+        baseline = threads == 1 ? time : baseline;
+        std::printf("[bench]   %2u threads: %8.3f ms, %5.2fx\n", threads, time, baseline / time);
+    }
+}
+
+/// Measures how many empty jobs the job system runs per second and how long an idle worker takes to steal a job
+void bench_jobs() {
+    constexpr u32 JOBS = 1 << 18;
+    constexpr u32 WAVE = 1024;
+    auto hardware = std::max(std::thread::hardware_concurrency(), 1u);
+    std::printf("\n[bench] Job system, %u empty jobs submitted in waves of %u\n", JOBS, WAVE);
+
+    for (u32 threads = 1; threads <= hardware; threads *= 2) {
+        JobSystem jobs{ threads - 1 };
+        auto time = measure(5, [&] {
+            for (u32 wave = 0; wave < JOBS; wave += WAVE) {
+                JobCounter counter;
+                for (u32 i = 0; i < WAVE; ++i) {
+                    jobs.submit([] {}, &counter);
+                }
+                jobs.wait(counter);
+            }
+        });
+        std::printf("[bench]   %2u threads: %8.3f ms, %6.2f million jobs per second\n", threads, time,
+                    JOBS / time / 1000.0);
+    }
+
+    if (hardware < 2) {
+        std::printf("[bench]   Steal latency needs a second hardware thread, skipped\n");
+        return;
+    }
+
+    // The main thread does not help while it waits, hence a worker has to steal every job from its queue
+    constexpr u32 SAMPLES = 2000;
+    JobSystem jobs{ 1 };
+    std::vector<f64> latencies;
+    latencies.reserve(SAMPLES);
+    for (u32 sample = 0; sample < SAMPLES; ++sample) {
+        std::atomic<s64> started{ 0 };
+        auto submitted = Clock::now();
+        jobs.submit([&started] { started.store(Clock::now().time_since_epoch().count(), std::memory_order_release); });
+        while (not started.load(std::memory_order_acquire)) {
+        }
+        auto stolen = Clock::time_point{ Clock::duration{ started.load(std::memory_order_relaxed) } };
+        latencies.push_back(std::chrono::duration<f64, std::micro>(stolen - submitted).count());
+
+        // The job still finishes after it stored the time, which has to happen before the next sample
+        while (jobs.pending.load(std::memory_order_acquire) > 0) {
+        }
+    }
+    std::ranges::sort(latencies);
+    std::printf("[bench]   Steal latency: %.2f us median, %.2f us at the 99th percentile\n", latencies[SAMPLES / 2],
+                latencies[SAMPLES * 99 / 100]);
+}
+
+/// Sorts and submits the quads of a frame that are spread across a growing number of textures, which shows what
+/// sorting costs against the number of batches it saves
+void bench_sorting(Renderer &renderer, const Window &window) {
+    constexpr usize QUADS = 100'000;
+    const glm::vec2 bounds{ static_cast<f32>(window.width), static_cast<f32>(window.height) };
+    auto extents = random_extents(QUADS, bounds);
+    std::vector<std::unique_ptr<Texture>> textures;
+    std::printf("\n[bench] Sorting, %zu textured quads per frame\n", QUADS);
+
+    for (usize count : { 1, 4, 16, 64 }) {
+        while (textures.size() < count) {
+            textures.push_back(std::make_unique<Texture>("assets/wn.png"));
+        }
+
+        RenderStats stats{};
+        auto time = measure(5, [&] {
+            renderer.begin(window.width, window.height);
+            for (usize i = 0; i < QUADS; ++i) {
+                renderer.draw_quad(extents[i], *textures[i % count]);
+            }
+            renderer.end();
+            glFinish();
+            stats = renderer.stats;
+        });
+        std::printf("[bench]   %2zu textures: %8.3f ms per frame, %4u draw calls, %6u batches merged\n", count, time,
+                    stats.draw_calls, stats.batches_merged);
+    }
+}
+
+/// Submits the quads of a frame with their vertices expanded as they are written and with the expansion split across
+/// the job system right before the draws, the latter only pays off with more than one core
+void bench_expansion(Renderer &renderer, const Window &window) {
+    constexpr usize QUADS = 200'000;
+    const glm::vec2 bounds{ static_cast<f32>(window.width), static_cast<f32>(window.height) };
+    auto extents = random_extents(QUADS, bounds);
+    Texture texture{ "assets/wn.png" };
+    JobSystem jobs{};
+    std::printf("\n[bench] Vertex expansion, %zu textured quads per frame, %u threads\n", QUADS, jobs.concurrency());
+
+    for (auto *system : { static_cast<JobSystem *>(nullptr), &jobs }) {
+        renderer.jobs = system;
+        auto time = measure(5, [&] {
+            renderer.begin(window.width, window.height);
+            for (const auto &extent : extents) {
+                renderer.draw_quad(extent, texture);
+            }
+            renderer.end();
+            glFinish();
+        });
+        std::printf("[bench]   %-8s %8.3f ms per frame\n", system ? "jobs" : "inline", time);
+    }
+    renderer.jobs = nullptr;
+}
+
+/// Draws overlapping opaque quads with and without the opaque pass, with it the depth test rejects hidden fragments
+void bench_opaque_pass(Renderer &renderer, const Window &window) {
+    constexpr usize QUADS = 2'000;
+    QuadExtent screen{};
+    screen.size = { static_cast<f32>(window.width), static_cast<f32>(window.height) };
+    std::vector<QuadExtent> extents(QUADS, screen);
+    std::vector<glm::vec4> colors(QUADS, glm::vec4{ 0.2f, 0.4f, 0.6f, 1.0f });
+    std::printf("\n[bench] Opaque pass, %zu overlapping full screen quads\n", QUADS);
+
+    for (auto enabled : { false, true }) {
+        renderer.set_opaque_layer(0, enabled);
+        auto time = measure(10, [&] {
+            renderer.begin(window.width, window.height);
+            renderer.draw_quads(extents, colors);
+            renderer.end();
+            glFinish();
+        });
+        std::printf("[bench]   %-8s %8.3f ms per frame, %6u opaque quads\n", enabled ? "enabled" : "disabled", time,
+                    renderer.stats.opaque_quads);
+    }
+    renderer.set_opaque_layer(0, false);
+}
+
+/// Sets a uniform through the shader by its id and by a name that is hashed at run time, against setting it through
+/// a location that is already known, the difference is what resolving the uniform costs
+void bench_uniform_set(Renderer &renderer) {
+    constexpr u32 CALLS = 1'000'000;
+    auto &shader = renderer.glyph_group.shader.variant(0);
+    auto location = glGetUniformLocation(shader.handle, "uniform_glyph_atlas");
+    std::string name = "uniform_glyph_atlas";
+    std::printf("\n[bench] Uniform updates, %u calls\n", CALLS);
+
+    auto report = [](const char *path, f64 time, u64 allocated) {
+        std::printf("[bench]   %-8s %8.3f ms, %5.2f ns per call, %llu allocations\n", path, time, time * 1e6 / CALLS,
+                    static_cast<unsigned long long>(allocated));
+    };
+
+    auto before = allocations.load();
+    auto time = measure(5, [&] {
+        for (u32 i = 0; i < CALLS; ++i) {
+            glProgramUniform1i(shader.handle, location, 0);
+        }
+    });
+    report("location", time, allocations.load() - before);
+
+    before = allocations.load();
+    time = measure(5, [&] {
+        for (u32 i = 0; i < CALLS; ++i) {
+            shader.uniform("uniform_glyph_atlas", 0);
+        }
+    });
+    report("id", time, allocations.load() - before);
+
+    before = allocations.load();
+    time = measure(5, [&] {
+        for (u32 i = 0; i < CALLS; ++i) {
+            shader.uniform(UniformId::from(name), 0);
+        }
+    });
+    report("name", time, allocations.load() - before);
+}
+
+/// Shapes distinct labels the first time and once they are cached, such that repeated labels cost a lookup
+void bench_shaping(Renderer &renderer) {
+    constexpr u32 LABELS = 1'000;
+    constexpr u32 REPEATS = 10;
+    std::vector<std::string> labels;
+    for (u32 i = 0; i < LABELS; ++i) {
+        labels.push_back("Label " + std::to_string(i) + ": The quick brown fox jumps over the lazy dog.");
+    }
+    std::printf("\n[bench] Text shaping, %u distinct labels\n", LABELS);
+
+    auto &cache = renderer.cache;
+    std::vector<ShapedGlyph> glyphs;
+    std::vector<GlyphInfo> infos;
+
+    // None of the labels was drawn before, hence the first pass misses the run cache for every one of them
+    cache.reset_stats();
+    auto shaped = measure(1, [&] {
+        for (const auto &label : labels) {
+            cache.shape(label, glyphs, infos);
+        }
+    });
+    auto cached = measure(1, [&] {
+        for (u32 repeat = 0; repeat < REPEATS; ++repeat) {
+            for (const auto &label : labels) {
+                cache.shape(label, glyphs, infos);
+            }
+        }
+    });
+    cached /= REPEATS;
+
+    auto stats = cache.stats();
+    auto hit_rate = 100.0 * stats.run_hits / std::max(stats.run_hits + stats.run_misses, 1u);
+    std::printf("[bench]   shaped %8.3f ms, %6.2f us per label\n", shaped, shaped * 1000.0 / LABELS);
+    std::printf("[bench]   cached %8.3f ms, %6.2f us per label, %5.2fx, %.1f%% hit rate\n", cached,
+                cached * 1000.0 / LABELS, shaped / cached, hit_rate);
+}
+
+}// namespace
+
+int main(int argc, char **argv) {
+    // The benchmarks that need a context are skipped if there is no display or if they are not wanted
+    auto headless = argc > 1 and std::string_view{ argv[1] } == "--headless";
+
+    bench_vertex_layout();
+    bench_quad_recording();
+    bench_parallel_recording();
+    bench_jobs();
+
+    if (headless or not glfwInit()) {
+        std::printf("\n[bench] No context, the benchmarks that need one are skipped\n");
+        return 0;
+    }
+
+    // The window stays hidden, without vsync frames are only bound by the work they do
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    WindowCreateInfo window_info{};
+    window_info.width = 1280;
+    window_info.height = 720;
+    window_info.title = "Benchmark";
+    Window window{ window_info };
+    Renderer renderer{};
+
+    // Programs compile in the background, measured frames must not skip the batches whose program is still pending
+    for (auto *group : { &renderer.glyph_group, &renderer.quad_group, &renderer.sprite_group }) {
+        group->shader.variant(0).wait();
+        group->shader.variant(ShaderVariants::TEXTURED).wait();
+    }
+
+    bench_sorting(renderer, window);
+    bench_expansion(renderer, window);
+    bench_opaque_pass(renderer, window);
+    bench_uniform_set(renderer);
+    bench_shaping(renderer);
+    return 0;
+}
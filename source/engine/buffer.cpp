@@ -24,6 +24,7 @@
 #include <cassert>
 
 #include "buffer.h"
+#include "state.h"
 
 namespace {
 
@@ -46,6 +47,22 @@ s32 shader_type_stride(ShaderType type) {
             return 3 * sizeof(float);
         case ShaderType::FLOAT4:
             return 4 * sizeof(float);
+        case ShaderType::UBYTE4_NORM:
+            return 4 * sizeof(GLubyte);
+        case ShaderType::USHORT2_NORM:
+            return 2 * sizeof(GLushort);
+        case ShaderType::USHORT4_NORM:
+            return 4 * sizeof(GLushort);
+        case ShaderType::HALF2:
+            return 2 * sizeof(GLhalf);
+        case ShaderType::HALF4:
+            return 4 * sizeof(GLhalf);
+        case ShaderType::SHORT2:
+            return 2 * sizeof(GLshort);
+        case ShaderType::USHORT:
+            return sizeof(GLushort);
+        case ShaderType::USHORT2:
+            return 2 * sizeof(GLushort);
         default:
             return 0;
     }
@@ -64,6 +81,18 @@ s32 shader_type_opengl(ShaderType type) {
         case ShaderType::FLOAT3:
         case ShaderType::FLOAT4:
             return GL_FLOAT;
+        case ShaderType::UBYTE4_NORM:
+            return GL_UNSIGNED_BYTE;
+        case ShaderType::USHORT2_NORM:
+        case ShaderType::USHORT4_NORM:
+        case ShaderType::USHORT:
+        case ShaderType::USHORT2:
+            return GL_UNSIGNED_SHORT;
+        case ShaderType::HALF2:
+        case ShaderType::HALF4:
+            return GL_HALF_FLOAT;
+        case ShaderType::SHORT2:
+            return GL_SHORT;
         default:
             return 0;
     }
@@ -88,11 +117,48 @@ s32 shader_type_primitives(ShaderType type) {
             return 3;
         case ShaderType::FLOAT4:
             return 4;
+        case ShaderType::UBYTE4_NORM:
+            return 4;
+        case ShaderType::USHORT2_NORM:
+            return 2;
+        case ShaderType::USHORT4_NORM:
+            return 4;
+        case ShaderType::HALF2:
+            return 2;
+        case ShaderType::HALF4:
+            return 4;
+        case ShaderType::SHORT2:
+            return 2;
+        case ShaderType::USHORT:
+            return 1;
+        case ShaderType::USHORT2:
+            return 2;
         default:
             return 0;
     }
 }
 
+/// Checks whether a shader type is read as a normalized float in the shader
+bool shader_type_normalized(ShaderType type) {
+    return type == ShaderType::UBYTE4_NORM or type == ShaderType::USHORT2_NORM or type == ShaderType::USHORT4_NORM;
+}
+
+/// Checks whether a shader type is read as an integer in the shader
+bool shader_type_integer(ShaderType type) {
+    switch (type) {
+        case ShaderType::INT:
+        case ShaderType::INT2:
+        case ShaderType::INT3:
+        case ShaderType::INT4:
+        case ShaderType::SHORT2:
+        case ShaderType::USHORT:
+        case ShaderType::USHORT2:
+            return true;
+        default:
+            return false;
+    }
+}
+
 /// Calculates the total stride of a vertex buffer layout
 s32 vertex_buffer_layout_stride(const VertexBufferLayout &layout) {
     s32 stride = 0;
@@ -102,91 +168,288 @@ s32 vertex_buffer_layout_stride(const VertexBufferLayout &layout) {
     return stride;
 }
 
+/// Sets the attributes of the vertex buffer layout for the currently bound vertex array and buffer
+void vertex_array_attributes(const VertexBufferLayout &layout, u32 location, u32 divisor) {
+    s64 offset = 0;
+    auto stride = vertex_buffer_layout_stride(layout);
+    for (u32 i = 0; i < layout.size(); ++i) {
+        auto index = location + i;
+        glEnableVertexAttribArray(index);
+        auto attribute = layout[i];
+        auto opengl_type = shader_type_opengl(attribute);
+        auto primitives = shader_type_primitives(attribute);
+        if (shader_type_integer(attribute)) {
+            glVertexAttribIPointer(index, primitives, opengl_type, stride, reinterpret_cast<const void *>(offset));
+        } else {
+            auto normalized = shader_type_normalized(attribute) ? GL_TRUE : GL_FALSE;
+            glVertexAttribPointer(index, primitives, opengl_type, normalized, stride,
+                                  reinterpret_cast<const void *>(offset));
+        }
+        glVertexAttribDivisor(index, divisor);
+        offset += shader_type_stride(attribute);
+    }
+}
+
 }// namespace
 
 /// Creates a vertex buffer on the gpu
 VertexBuffer::VertexBuffer() : handle(0), layout() {
     glGenBuffers(1, &handle);
-    glBindBuffer(GL_ARRAY_BUFFER, handle);
+    GLStateCache::current().bind_buffer(GL_ARRAY_BUFFER, handle);
 }
 
 /// Destroys the vertex buffer
 VertexBuffer::~VertexBuffer() {
+    GLStateCache::current().release_buffer(handle);
     glDeleteBuffers(1, &handle);
 }
 
 /// Binds the vertex buffer
 void VertexBuffer::bind() const {
-    glBindBuffer(GL_ARRAY_BUFFER, handle);
+    GLStateCache::current().bind_buffer(GL_ARRAY_BUFFER, handle);
 }
 
 /// Unbinds the currently bound vertex buffer
 void VertexBuffer::unbind() {
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GLStateCache::current().bind_buffer(GL_ARRAY_BUFFER, 0);
+}
+
+/// Creates a persistently mapped streaming buffer on the gpu, which is split into frame regions
+StreamBuffer::StreamBuffer(usize region_size)
+    : handle(0),
+      mapping(nullptr),
+      region_size(region_size),
+      region(0),
+      head(0),
+      stalls(0),
+      layout(),
+      fences() {
+    allocate();
+}
+
+/// Unmaps and destroys the stream buffer
+StreamBuffer::~StreamBuffer() {
+    for (auto &fence : fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    glUnmapNamedBuffer(handle);
+    GLStateCache::current().release_buffer(handle);
+    glDeleteBuffers(1, &handle);
+}
+
+/// Reserves memory in the current region
+void *StreamBuffer::map(usize size) {
+    if (head + size > region_size) {
+        return nullptr;
+    }
+    auto *memory = mapping + region * region_size + head;
+    head += size;
+    return memory;
+}
+
+/// Retrieves the byte offset at which the next reservation will be placed
+usize StreamBuffer::offset() const {
+    return region * region_size + head;
+}
+
+/// Fences the current region and moves on to the next one, waiting for the gpu to release it
+bool StreamBuffer::advance() {
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % REGION_COUNT;
+    head = 0;
+    return wait(region);
+}
+
+/// Reallocates the buffer storage with the specified region size, this waits for all regions to be released
+void StreamBuffer::resize(usize size) {
+    for (u32 i = 0; i < REGION_COUNT; ++i) {
+        wait(i);
+    }
+    glUnmapNamedBuffer(handle);
+    GLStateCache::current().release_buffer(handle);
+    glDeleteBuffers(1, &handle);
+
+    region_size = size;
+    region = 0;
+    head = 0;
+    allocate();
+}
+
+/// Binds the stream buffer
+void StreamBuffer::bind() const {
+    GLStateCache::current().bind_buffer(GL_ARRAY_BUFFER, handle);
+}
+
+/// Allocates and maps the storage of the buffer
+void StreamBuffer::allocate() {
+    constexpr auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    auto size = static_cast<GLsizeiptr>(region_size * REGION_COUNT);
+    glCreateBuffers(1, &handle);
+    glNamedBufferStorage(handle, size, nullptr, flags);
+    mapping = static_cast<u8 *>(glMapNamedBufferRange(handle, 0, size, flags));
+    if (not mapping) {
+        assert(false and "[buffer] Failed to map stream buffer!");
+    }
+}
+
+/// Waits for the gpu to release the specified region
+bool StreamBuffer::wait(u32 index) {
+    auto &fence = fences[index];
+    if (not fence) {
+        return false;
+    }
+
+    auto stalled = false;
+    auto result = glClientWaitSync(fence, 0, 0);
+    while (result == GL_TIMEOUT_EXPIRED) {
+        stalled = true;
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+
+    if (stalled) {
+        stalls++;
+    }
+    return stalled;
+}
+
+/// Creates a shader storage buffer on the gpu
+StorageBuffer::StorageBuffer() : handle(0) {
+    glCreateBuffers(1, &handle);
+}
+
+/// Destroys the shader storage buffer
+StorageBuffer::~StorageBuffer() {
+    GLStateCache::current().release_buffer(handle);
+    glDeleteBuffers(1, &handle);
+}
+
+/// Binds the storage buffer to the specified binding point
+void StorageBuffer::bind(u32 binding) const {
+    GLStateCache::current().bind_buffer_base(GL_SHADER_STORAGE_BUFFER, binding, handle);
+}
+
+/// Creates a uniform buffer on the gpu
+UniformBuffer::UniformBuffer() : handle(0) {
+    glCreateBuffers(1, &handle);
+}
+
+/// Destroys the uniform buffer
+UniformBuffer::~UniformBuffer() {
+    GLStateCache::current().release_buffer(handle);
+    glDeleteBuffers(1, &handle);
+}
+
+/// Sets the data for the uniform buffer, the previous storage is orphaned such that the gpu may still read it
+void UniformBuffer::submit(const void *data, usize size) {
+    glNamedBufferData(handle, static_cast<GLsizeiptr>(size), data, GL_STREAM_DRAW);
+}
+
+/// Binds the uniform buffer to the specified binding point
+void UniformBuffer::bind(u32 binding) const {
+    GLStateCache::current().bind_buffer_base(GL_UNIFORM_BUFFER, binding, handle);
+}
+
+/// Binds a range of the uniform buffer to the specified binding point
+void UniformBuffer::bind(u32 binding, usize offset, usize size) const {
+    GLStateCache::current().bind_buffer_range(GL_UNIFORM_BUFFER, binding, handle, offset, size);
+}
+
+/// Creates a draw indirect buffer on the gpu
+IndirectBuffer::IndirectBuffer() : handle(0) {
+    glCreateBuffers(1, &handle);
+}
+
+/// Destroys the draw indirect buffer
+IndirectBuffer::~IndirectBuffer() {
+    GLStateCache::current().release_buffer(handle);
+    glDeleteBuffers(1, &handle);
+}
+
+/// Sets the draw commands of the indirect buffer, the previous storage is orphaned such that the gpu may still read it
+void IndirectBuffer::submit(const std::vector<DrawElementsIndirectCommand> &commands) {
+    auto size = static_cast<GLsizeiptr>(commands.size() * sizeof(DrawElementsIndirectCommand));
+    glNamedBufferData(handle, size, commands.data(), GL_STREAM_DRAW);
+}
+
+/// Binds the indirect buffer as the source of indirect draw commands
+void IndirectBuffer::bind() const {
+    GLStateCache::current().bind_buffer(GL_DRAW_INDIRECT_BUFFER, handle);
 }
 
 /// Creates an index buffer on the gpu
-IndexBuffer::IndexBuffer() : handle(0), count(0) {
+IndexBuffer::IndexBuffer() : handle(0), count(0), capacity(0) {
     glGenBuffers(1, &handle);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle);
+    GLStateCache::current().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, handle);
 }
 
 /// Destroys the index buffer
 IndexBuffer::~IndexBuffer() {
+    GLStateCache::current().release_buffer(handle);
     glDeleteBuffers(1, &handle);
 }
 
-/// Sets the data for the specified index buffer
+/// Sets the data for the specified index buffer, the storage is only reallocated when it needs to grow
 void IndexBuffer::submit(const std::vector<u32> &indices) {
-    auto size = static_cast<GLsizeiptr>(indices.size() * sizeof(u32));
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, indices.data(), GL_DYNAMIC_DRAW);
+    if (indices.size() > capacity) {
+        capacity = indices.size();
+        glNamedBufferData(handle, static_cast<GLsizeiptr>(capacity * sizeof(u32)), nullptr, GL_DYNAMIC_DRAW);
+    }
+    glNamedBufferSubData(handle, 0, static_cast<GLsizeiptr>(indices.size() * sizeof(u32)), indices.data());
     count = indices.size();
 }
 
+/// Replaces the storage of the index buffer with immutable storage that holds the indices
+void IndexBuffer::store(const std::vector<u32> &indices) {
+    GLStateCache::current().release_buffer(handle);
+    glDeleteBuffers(1, &handle);
+    glCreateBuffers(1, &handle);
+    glNamedBufferStorage(handle, static_cast<GLsizeiptr>(indices.size() * sizeof(u32)), indices.data(), 0);
+    count = indices.size();
+    capacity = indices.size();
+}
+
 /// Binds the specified buffer
 void IndexBuffer::bind() const {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle);
+    GLStateCache::current().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, handle);
 }
 
 /// Unbinds the currently bound index buffer
 void IndexBuffer::unbind() {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    GLStateCache::current().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 /// Creates a new vertex array
-VertexArray::VertexArray() : handle(0), vertex_buffer(nullptr), index_buffer(nullptr) {
+VertexArray::VertexArray() : handle(0), vertex_buffer(nullptr), stream_buffer(nullptr), index_buffer(nullptr) {
     glGenVertexArrays(1, &handle);
-    glBindVertexArray(handle);
+    GLStateCache::current().bind_vertex_array(handle);
 }
 
 /// Destroys the vertex array
 VertexArray::~VertexArray() {
+    GLStateCache::current().release_vertex_array(handle);
     glDeleteVertexArrays(1, &handle);
 }
 
 /// Sets the vertex buffer for the vertex array, this sets all the specified attributes
-void VertexArray::submit(VertexBuffer *buffer) {
+void VertexArray::submit(VertexBuffer *buffer, u32 location, u32 divisor) {
     this->bind();
     buffer->bind();
-
-    s64 offset = 0;
-    auto stride = vertex_buffer_layout_stride(buffer->layout);
-    for (u32 i = 0; i < buffer->layout.size(); ++i) {
-        glEnableVertexAttribArray(i);
-        auto attribute = buffer->layout[i];
-        auto opengl_type = shader_type_opengl(attribute);
-        auto primitives = shader_type_primitives(attribute);
-        if (opengl_type == GL_FLOAT) {
-            glVertexAttribPointer(i, primitives, opengl_type, GL_FALSE, stride, reinterpret_cast<const void *>(offset));
-        } else if (opengl_type == GL_INT) {
-            glVertexAttribIPointer(i, primitives, opengl_type, stride, reinterpret_cast<const void *>(offset));
-        }
-        offset += shader_type_stride(attribute);
-    }
+    vertex_array_attributes(buffer->layout, location, divisor);
     vertex_buffer = buffer;
 }
 
+/// Sets the stream buffer for the vertex array, this sets all the specified attributes
+void VertexArray::submit(StreamBuffer *buffer, u32 location, u32 divisor) {
+    this->bind();
+    buffer->bind();
+    vertex_array_attributes(buffer->layout, location, divisor);
+    stream_buffer = buffer;
+}
+
 /// Sets the index buffer for the vertex array
 void VertexArray::submit(IndexBuffer *buffer) {
     this->bind();
@@ -196,12 +459,12 @@ void VertexArray::submit(IndexBuffer *buffer) {
 
 /// Binds the vertex array
 void VertexArray::bind() const {
-    glBindVertexArray(handle);
+    GLStateCache::current().bind_vertex_array(handle);
 }
 
 /// Unbinds the currently bound vertex array
 void VertexArray::unbind() {
-    glBindVertexArray(0);
+    GLStateCache::current().bind_vertex_array(0);
 }
 
 /// Creates a new frame buffer
@@ -211,6 +474,9 @@ FrameBuffer::FrameBuffer(const FrameBufferInfo &info) : handle(0), texture_handl
 
 /// Destroys the frame buffer
 FrameBuffer::~FrameBuffer() {
+    auto &state = GLStateCache::current();
+    state.release_framebuffer(handle);
+    state.release_texture(texture_handle);
     glDeleteFramebuffers(1, &handle);
     glDeleteTextures(1, &texture_handle);
     glDeleteRenderbuffers(1, &render_handle);
@@ -218,17 +484,21 @@ FrameBuffer::~FrameBuffer() {
 
 /// Invalidates the frame buffer, this needs to be called whenever the frame buffer is resized
 void FrameBuffer::invalidate() {
+    auto &state = GLStateCache::current();
     if (handle) {
+        state.release_framebuffer(handle);
+        state.release_texture(texture_handle);
         glDeleteFramebuffers(1, &handle);
         glDeleteTextures(1, &texture_handle);
         glDeleteRenderbuffers(1, &render_handle);
     }
 
     glGenFramebuffers(1, &handle);
-    glBindFramebuffer(GL_FRAMEBUFFER, handle);
+    state.bind_framebuffer(handle);
 
-    glGenTextures(1, &texture_handle);
-    glBindTexture(GL_TEXTURE_2D, texture_handle);
+    // The texture is edited through the binding of the first unit, which is the active one
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture_handle);
+    state.bind_texture_unit(0, texture_handle);
     glTexImage2D(GL_TEXTURE_2D, 0, info.internal_format, info.width, info.height, 0, info.pixel_format, info.pixel_type,
                  nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -246,7 +516,7 @@ void FrameBuffer::invalidate() {
         assert(false and "[framebuffer] Invalid frame buffer!");
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    state.bind_framebuffer(0);
 }
 
 /// Resizes the frame buffer
@@ -262,16 +532,17 @@ void FrameBuffer::resize(s32 width, s32 height) {
 
 /// Binds the specified frame buffer for rendering
 void FrameBuffer::bind() const {
-    glBindFramebuffer(GL_FRAMEBUFFER, handle);
-    glViewport(0, 0, info.width, info.height);
+    auto &state = GLStateCache::current();
+    state.bind_framebuffer(handle);
+    state.viewport(0, 0, info.width, info.height);
 }
 
 /// Binds the texture of the frame buffer at the specified sampler slot
 void FrameBuffer::bind_texture(u32 slot) const {
-    glBindTextureUnit(slot, texture_handle);
+    GLStateCache::current().bind_texture_unit(slot, texture_handle);
 }
 
 /// Unbinds the currently bound frame buffer
 void FrameBuffer::unbind() {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLStateCache::current().bind_framebuffer(0);
 }
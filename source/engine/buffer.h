@@ -25,7 +25,9 @@
 #define ENGINE_BUFFER_H
 
 #include "shader.h"
+#include "state.h"
 
+#include <array>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -46,7 +48,7 @@ struct VertexBuffer {
     /// @param data The vertex data
     template<typename T>
     void submit(const std::vector<T> &data) {
-        glBindBuffer(GL_ARRAY_BUFFER, handle);
+        GLStateCache::current().bind_buffer(GL_ARRAY_BUFFER, handle);
         glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(T), data.data(), GL_DYNAMIC_DRAW);
     }
 
@@ -57,9 +59,131 @@ struct VertexBuffer {
     static void unbind();
 };
 
+struct StreamBuffer {
+    u32 handle;
+    u8 *mapping;
+    usize region_size;
+    u32 region;
+    usize head;
+    u64 stalls;
+    VertexBufferLayout layout;
+
+    static inline constexpr u32 REGION_COUNT = 3;
+    std::array<GLsync, REGION_COUNT> fences;
+
+    /// Creates a persistently mapped streaming buffer on the gpu, which is split into frame regions
+    /// @param region_size The size of a single frame region in bytes
+    explicit StreamBuffer(usize region_size);
+
+    /// Unmaps and destroys the stream buffer
+    ~StreamBuffer();
+
+    /// Reserves memory in the current region
+    /// @param size The size of the reservation in bytes
+    /// @return The mapped memory or nullptr if the current region cannot hold the reservation
+    void *map(usize size);
+
+    /// Retrieves the byte offset at which the next reservation will be placed
+    /// @return The offset from the start of the buffer
+    usize offset() const;
+
+    /// Fences the current region and moves on to the next one, waiting for the gpu to release it
+    /// @return A boolean value that indicates whether the cpu had to stall on the fence
+    bool advance();
+
+    /// Reallocates the buffer storage with the specified region size, this waits for all regions to be released
+    /// @param size The new size of a single frame region in bytes
+    void resize(usize size);
+
+    /// Binds the stream buffer
+    void bind() const;
+
+private:
+    /// Allocates and maps the storage of the buffer
+    void allocate();
+
+    /// Waits for the gpu to release the specified region
+    /// @param index The region index
+    /// @return A boolean value that indicates whether the cpu had to stall on the fence
+    bool wait(u32 index);
+};
+
+struct StorageBuffer {
+    u32 handle;
+
+    /// Creates a shader storage buffer on the gpu
+    StorageBuffer();
+
+    /// Destroys the shader storage buffer
+    ~StorageBuffer();
+
+    /// Sets the data for the storage buffer, the previous storage is orphaned such that the gpu may still read it
+    /// @param data The data
+    template<typename T>
+    void submit(const std::vector<T> &data) {
+        glNamedBufferData(handle, static_cast<GLsizeiptr>(data.size() * sizeof(T)), data.data(), GL_STREAM_DRAW);
+    }
+
+    /// Binds the storage buffer to the specified binding point
+    /// @param binding The binding point
+    void bind(u32 binding) const;
+};
+
+struct UniformBuffer {
+    u32 handle;
+
+    /// Creates a uniform buffer on the gpu
+    UniformBuffer();
+
+    /// Destroys the uniform buffer
+    ~UniformBuffer();
+
+    /// Sets the data for the uniform buffer, the previous storage is orphaned such that the gpu may still read it
+    /// @param data The data, which needs to be laid out as std140
+    /// @param size The size of the data in bytes
+    void submit(const void *data, usize size);
+
+    /// Binds the uniform buffer to the specified binding point
+    /// @param binding The binding point
+    void bind(u32 binding) const;
+
+    /// Binds a range of the uniform buffer to the specified binding point
+    /// @param binding The binding point
+    /// @param offset The offset of the range in bytes, which needs to be a multiple of the offset alignment
+    /// @param size The size of the range in bytes
+    void bind(u32 binding, usize offset, usize size) const;
+};
+
+struct DrawElementsIndirectCommand {
+    u32 count;
+    u32 instance_count;
+    u32 first_index;
+    s32 base_vertex;
+    u32 base_instance;
+};
+
+struct IndirectBuffer {
+    u32 handle;
+
+    /// Creates a draw indirect buffer on the gpu
+    IndirectBuffer();
+
+    /// Destroys the draw indirect buffer
+    ~IndirectBuffer();
+
+    /// Sets the draw commands of the indirect buffer, the previous storage is orphaned such that the gpu may still
+    /// read it
+    /// @param commands The draw commands
+    void submit(const std::vector<DrawElementsIndirectCommand> &commands);
+
+    /// Binds the indirect buffer as the source of indirect draw commands
+    void bind() const;
+};
+
 struct IndexBuffer {
     u32 handle;
     u32 count;
+    usize capacity;
 
     /// Creates an index buffer on the gpu
     IndexBuffer();
@@ -71,6 +195,11 @@ struct IndexBuffer {
     /// @param indices The indices
     void submit(const std::vector<u32> &indices);
 
+    /// Replaces the storage of the index buffer with immutable storage that holds the indices, note that this
+    /// recreates the buffer, hence it needs to be resubmitted to the vertex arrays that use it
+    /// @param indices The indices
+    void store(const std::vector<u32> &indices);
+
     /// Binds the index buffer
     void bind() const;
 
@@ -81,6 +210,7 @@ struct IndexBuffer {
 struct VertexArray {
     u32 handle;
     VertexBuffer *vertex_buffer;
+    StreamBuffer *stream_buffer;
     IndexBuffer *index_buffer;
 
     /// Creates a new vertex array
@@ -91,7 +221,14 @@ struct VertexArray {
 
     /// Submits the vertex buffer to the vertex array, this sets all the specified attributes
     /// @param buffer The vertex buffer handle
-    void submit(VertexBuffer *buffer);
+    /// @param location The attribute location of the first attribute in the layout
+    /// @param divisor The attribute divisor, zero advances per vertex, n advances every n instances
+    void submit(VertexBuffer *buffer, u32 location = 0, u32 divisor = 0);
+    /// Submits the stream buffer to the vertex array, this sets all the specified attributes
+    /// @param buffer The stream buffer handle
+    /// @param location The attribute location of the first attribute in the layout
+    /// @param divisor The attribute divisor, zero advances per vertex, n advances every n instances
+    void submit(StreamBuffer *buffer, u32 location = 0, u32 divisor = 0);
     /// Submits the index buffer to the vertex array
     /// @param buffer The index buffer handle
     void submit(IndexBuffer *buffer);
@@ -23,95 +23,417 @@
 
 #include "glyph.h"
 #include "file.h"
+#include "state.h"
 
 // clang-format off
+#include <algorithm>
+#include <cstdio>
 #include <freetype/freetype.h>
-#include <fstream>
-#include <iterator>
+#include <hb-ft.h>
+#include <hb.h>
+#include <limits>
 // clang-format on
 
+namespace {
+
+/// Hashes the specified data with 64-bit FNV-1a, continuing from the specified hash
+u64 fnv1a(std::string_view data, u64 hash = 14695981039346656037ull) {
+    for (auto c : data) {
+        hash = (hash ^ static_cast<u8>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/// Finds the lowest position of the skyline that a rectangle of the specified size fits at, ties are broken by the
+/// narrowest segment, such that wide gaps stay free for wide glyphs
+/// @return The index of the segment that the rectangle starts at, or -1 if it fits nowhere
+s32 skyline_fit(const std::vector<SkylineNode> &skyline, glm::ivec2 size, glm::ivec2 &position) {
+    s32 best = -1;
+    auto best_y = std::numeric_limits<s32>::max();
+    auto best_width = std::numeric_limits<s32>::max();
+    for (usize i = 0; i < skyline.size(); ++i) {
+        auto x = skyline[i].x;
+        if (x + size.x > GlyphCache::PAGE_SIZE) {
+            break;
+        }
+
+        // The rectangle rests on the highest segment below it
+        s32 y = 0;
+        for (usize j = i, covered = 0; covered < static_cast<usize>(size.x); ++j) {
+            y = std::max(y, skyline[j].y);
+            covered += static_cast<usize>(skyline[j].width);
+        }
+        if (y + size.y > GlyphCache::PAGE_SIZE) {
+            continue;
+        }
+        if (y < best_y or (y == best_y and skyline[i].width < best_width)) {
+            best = static_cast<s32>(i);
+            best_y = y;
+            best_width = skyline[i].width;
+            position = { x, y };
+        }
+    }
+    return best;
+}
+
+/// Raises the skyline over a rectangle that was placed at the specified segment
+void skyline_insert(std::vector<SkylineNode> &skyline, usize index, glm::ivec2 position, glm::ivec2 size) {
+    skyline.insert(skyline.begin() + static_cast<std::ptrdiff_t>(index),
+                   SkylineNode{ position.x, position.y + size.y, size.x });
+
+    // The segments below the rectangle are shortened or removed
+    auto end = position.x + size.x;
+    for (auto i = index + 1; i < skyline.size();) {
+        auto &node = skyline[i];
+        if (node.x >= end) {
+            break;
+        }
+        auto covered = end - node.x;
+        if (node.width <= covered) {
+            skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i));
+            continue;
+        }
+        node.x += covered;
+        node.width -= covered;
+        break;
+    }
+
+    // Neighbouring segments of equal height are merged
+    for (usize i = 0; i + 1 < skyline.size();) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i) + 1);
+        } else {
+            ++i;
+        }
+    }
+}
+
+}// namespace
+
 /// Creates a glyph cache for the specified font
-GlyphCache::GlyphCache(const fs::path &path) : atlas{}, info{} {
+GlyphCache::GlyphCache(const fs::path &path)
+    : path(path),
+      font(),
+      library(nullptr),
+      face(nullptr),
+      shaper(nullptr),
+      buffer(hb_buffer_create()),
+      font_id(0),
+      ascender(0),
+      atlas(0),
+      pages(PAGE_COUNT),
+      indices(),
+      glyphs(),
+      uploads(),
+      mutex(),
+      frame(1),
+      runs(),
+      run_hits(0),
+      run_misses(0) {
+    if (FT_Init_FreeType(&library)) {
+        assert(false && "[glyph] Cannot initialize FreeType!");
+    }
+
     auto content = File::read(path, std::ios::binary);
-    if (not content) {
+    if (not content or not reload(std::move(*content))) {
         assert(false && "[glyph] Cannot load font!");
     }
 
-    FT_Library library;
-    if (FT_Init_FreeType(&library)) {
-        assert(false && "[glyph] Cannot initialize FreeType!");
+    // The pages are layers of a single array texture, which bounds the memory of the atlas
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &atlas);
+    glTextureStorage3D(atlas, 1, GL_R8, PAGE_SIZE, PAGE_SIZE, PAGE_COUNT);
+    glClearTexImage(atlas, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    glTextureParameteri(atlas, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(atlas, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(atlas, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(atlas, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    GLint swizzle[] = { GL_ZERO, GL_ZERO, GL_ZERO, GL_RED };
+    glTextureParameteriv(atlas, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+/// Destroys the font and the atlas
+GlyphCache::~GlyphCache() {
+    hb_buffer_destroy(buffer);
+    if (shaper) {
+        hb_font_destroy(shaper);
     }
+    if (face) {
+        FT_Done_Face(face);
+    }
+    FT_Done_FreeType(library);
+    GLStateCache::current().release_texture(atlas);
+    glDeleteTextures(1, &atlas);
+}
+
+/// Replaces the font
+bool GlyphCache::reload(std::string content) {
+    std::lock_guard lock{ mutex };
 
-    FT_Face face;
-    if (FT_New_Memory_Face(library, (FT_Byte *) content->c_str(), (FT_Long) content->size(), 0, &face)) {
-        FT_Done_FreeType(library);
-        assert(false && "[glyph] Cannot allocate font memory for FreeType!");
+    // FreeType reads the glyphs from the content as long as the face lives
+    FT_Face replacement;
+    if (FT_New_Memory_Face(library, (FT_Byte *) content.c_str(), (FT_Long) content.size(), 0, &replacement)) {
+        std::fprintf(stderr, "[glyph] Cannot allocate font memory for FreeType!\n");
+        return false;
     }
-    FT_Set_Pixel_Sizes(face, 0, FONT_SIZE);
+    FT_Set_Pixel_Sizes(replacement, 0, FONT_SIZE);
+    if (shaper) {
+        hb_font_destroy(shaper);
+    }
+    if (face) {
+        FT_Done_Face(face);
+    }
+    face = replacement;
+    font.swap(content);
+    ascender = static_cast<s32>(face->size->metrics.ascender >> 6);
 
-    // calculate combined size of glyphs
-    glm::i32vec2 size = { 0, 0 };
-    for (s32 i = 32; i < 128; i++) {
-        if (FT_Load_Char(face, (FT_ULong) i, FT_LOAD_RENDER)) {
-            fprintf(stderr, "could not load character: %c\n", (char) i);
-            continue;
+    // HarfBuzz shapes with the metrics of the sized face, such that its advances match the rasterized glyphs
+    shaper = hb_ft_font_create_referenced(face);
+    font_id++;
+    runs.clear();
+
+    indices.clear();
+    glyphs.clear();
+    uploads.clear();
+    for (s32 page = 0; page < PAGE_COUNT; ++page) {
+        evict(page);
+    }
+    return true;
+}
+
+/// Fetches the glyph of the specified codepoint
+GlyphInfo GlyphCache::acquire(u32 codepoint) {
+    std::lock_guard lock{ mutex };
+    return lookup(codepoint);
+}
+
+/// Fetches the glyphs of the specified codepoints at once
+void GlyphCache::acquire(std::span<const u32> codepoints, std::vector<GlyphInfo> &infos) {
+    std::lock_guard lock{ mutex };
+    for (auto codepoint : codepoints) {
+        infos.push_back(lookup(codepoint));
+    }
+}
+
+/// Shapes a line of UTF-8 text and fetches its glyphs
+void GlyphCache::shape(std::string_view text, std::vector<ShapedGlyph> &shaped, std::vector<GlyphInfo> &infos) {
+    std::lock_guard lock{ mutex };
+    const auto &shaped_run = run(text);
+    shaped.insert(shaped.end(), shaped_run.glyphs.begin(), shaped_run.glyphs.end());
+    for (const auto &glyph : shaped_run.glyphs) {
+        infos.push_back(lookup_index(glyph.index));
+    }
+}
+
+/// Counts the glyphs that a line of UTF-8 text is shaped into
+u32 GlyphCache::glyph_count(std::string_view text) {
+    std::lock_guard lock{ mutex };
+    return static_cast<u32>(run(text).glyphs.size());
+}
+
+/// Retrieves the generations of the pages
+std::array<u32, GlyphCache::PAGE_COUNT> GlyphCache::generations() {
+    std::lock_guard lock{ mutex };
+    std::array<u32, PAGE_COUNT> result;
+    for (s32 page = 0; page < PAGE_COUNT; ++page) {
+        result[page] = pages[page].generation;
+    }
+    return result;
+}
+
+/// Marks the specified pages as used by the current frame
+bool GlyphCache::touch(u32 page_mask, const std::array<u32, PAGE_COUNT> &generations) {
+    std::lock_guard lock{ mutex };
+    for (s32 page = 0; page < PAGE_COUNT; ++page) {
+        if (page_mask & (1u << page) and pages[page].generation != generations[page]) {
+            return false;
         }
+    }
+    for (s32 page = 0; page < PAGE_COUNT; ++page) {
+        if (page_mask & (1u << page)) {
+            pages[page].last_used = frame;
+        }
+    }
+    return true;
+}
 
-        GlyphInfo *glyph = (this->info + i - 32);
-        glyph->size.x = static_cast<s32>(face->glyph->bitmap.width);
-        glyph->size.y = static_cast<s32>(face->glyph->bitmap.rows);
-        glyph->bearing.x = face->glyph->bitmap_left;
-        glyph->bearing.y = face->glyph->bitmap_top;
-        glyph->advance.x = face->glyph->advance.x >> 6;
-        glyph->advance.y = face->glyph->advance.y >> 6;
-        glyph->texture_span.x = 0.0f;
-        glyph->texture_span.y = 0.0f;
-        glyph->texture_offset = 0.0f;
-        size.x += glyph->advance.x;
-        size.y = std::max(size.y, glyph->size.y);
-    }
-
-    atlas.data = nullptr;
-    atlas.handle = 0;
-    atlas.width = static_cast<s32>(size.x);
-    atlas.height = static_cast<s32>(size.y);
-    atlas.channels = 1;
-
-    glCreateTextures(GL_TEXTURE_2D, 1, &atlas.handle);
-    glBindTextureUnit(0, atlas.handle);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    std::vector<GLuint> zeros(size.x * size.y, 0);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, size.x, size.y, 0, GL_RED, GL_UNSIGNED_BYTE, zeros.data());
+/// Retrieves the counters of the run cache since they were last reset
+ShapeStats GlyphCache::stats() {
+    std::lock_guard lock{ mutex };
+    return { run_hits, run_misses };
+}
 
-    GLint swizzle[] = { GL_ZERO, GL_ZERO, GL_ZERO, GL_RED };
-    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+/// Resets the counters of the run cache
+void GlyphCache::reset_stats() {
+    std::lock_guard lock{ mutex };
+    run_hits = 0;
+    run_misses = 0;
+}
 
-    s32 offset = 0;
-    for (u32 i = 0; i < 96; i++) {
-        // unfortunately we still need to load the character again, as we need its bitmap buffer for the upload
-        if (FT_Load_Char(face, i + 32, FT_LOAD_RENDER) or face->glyph->bitmap.buffer == nullptr) {
-            continue;
+/// Uploads the glyphs that were rasterized since the last flush and begins the next frame
+void GlyphCache::flush() {
+    std::lock_guard lock{ mutex };
+    if (not uploads.empty()) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (const auto &upload : uploads) {
+            glTextureSubImage3D(atlas, 0, upload.position.x, upload.position.y, upload.page, upload.size.x,
+                                upload.size.y, 1, GL_RED, GL_UNSIGNED_BYTE, upload.pixels.data());
         }
-        GlyphInfo *glyph = (this->info + i);
-        glyph->texture_offset = static_cast<f32>(offset) / static_cast<f32>(size.x);
-        glyph->texture_span.x = static_cast<f32>(glyph->size.x) / static_cast<f32>(size.x);
-        glyph->texture_span.y = static_cast<f32>(glyph->size.y) / static_cast<f32>(size.y);
-        glyph->bearing.y -= size.y - glyph->size.y;
-        glTexSubImage2D(GL_TEXTURE_2D, 0, offset, 0, glyph->size.x, glyph->size.y, GL_RED, GL_UNSIGNED_BYTE,
-                        face->glyph->bitmap.buffer);
-        offset += glyph->advance.x;
+        uploads.clear();
     }
+    frame++;
+}
 
-    FT_Done_Face(face);
-    FT_Done_FreeType(library);
+/// Binds the atlas to the sampler at the specified slot
+void GlyphCache::bind(u32 slot) const {
+    GLStateCache::current().bind_texture_unit(slot, atlas);
 }
 
-/// Fetches the specified symbol from the glyph cache
-GlyphInfo &GlyphCache::acquire(char symbol) {
-    return info[symbol - 32];
+/// Fetches the glyph of the specified codepoint
+GlyphInfo GlyphCache::lookup(u32 codepoint) {
+    auto [index, inserted] = indices.try_emplace(codepoint, 0);
+    if (inserted) {
+        index->second = FT_Get_Char_Index(face, codepoint);
+    }
+
+    return lookup_index(index->second);
+}
+
+/// Fetches the glyph of the specified glyph index
+GlyphInfo GlyphCache::lookup_index(u32 index) {
+    auto glyph = glyphs.find(index);
+    if (glyph == glyphs.end()) {
+        return rasterize(index);
+    }
+    if (glyph->second.page >= 0) {
+        pages[glyph->second.page].last_used = frame;
+    }
+    return glyph->second;
+}
+
+/// Retrieves the shaped run of a line of text
+const ShapedRun &GlyphCache::run(std::string_view text) {
+    // The text is compared as well, such that colliding hashes never draw the wrong run
+    u32 header[] = { font_id, static_cast<u32>(FONT_SIZE) };
+    auto key = fnv1a(text, fnv1a({ reinterpret_cast<const char *>(header), sizeof(header) }));
+    if (auto it = runs.find(key); it != runs.end() and it->second.text == text) {
+        run_hits++;
+        return it->second;
+    }
+    run_misses++;
+
+    // Labels that change every frame would grow the cache without bounds
+    if (runs.size() >= RUN_MAX) {
+        runs.clear();
+    }
+
+    hb_buffer_clear_contents(buffer);
+    hb_buffer_add_utf8(buffer, text.data(), static_cast<s32>(text.size()), 0, static_cast<s32>(text.size()));
+    hb_buffer_guess_segment_properties(buffer);
+    hb_shape(shaper, buffer, nullptr, 0);
+
+    u32 count = 0;
+    const auto *glyph_infos = hb_buffer_get_glyph_infos(buffer, &count);
+    const auto *glyph_positions = hb_buffer_get_glyph_positions(buffer, &count);
+
+    // HarfBuzz positions are given in 26.6 fixed point with the y axis pointing up
+    auto &shaped_run = runs[key];
+    shaped_run.text = text;
+    shaped_run.glyphs.clear();
+    shaped_run.glyphs.reserve(count);
+    for (u32 i = 0; i < count; ++i) {
+        const auto &position = glyph_positions[i];
+        auto offset = glm::vec2{ static_cast<f32>(position.x_offset), static_cast<f32>(-position.y_offset) } / 64.0f;
+        shaped_run.glyphs.push_back(
+                ShapedGlyph{ glyph_infos[i].codepoint, offset, static_cast<f32>(position.x_advance) / 64.0f });
+    }
+    return shaped_run;
+}
+
+/// Rasterizes a glyph and packs it into a page
+GlyphInfo GlyphCache::rasterize(u32 index) {
+    GlyphInfo info{};
+    info.page = -1;
+    if (FT_Load_Glyph(face, index, FT_LOAD_RENDER)) {
+        std::fprintf(stderr, "[glyph] Could not load glyph %u!\n", index);
+        return glyphs[index] = info;
+    }
+
+    // The bearing is relative to the top of the line, such that glyphs are placed below their line position
+    const auto &bitmap = face->glyph->bitmap;
+    info.size = { static_cast<s32>(bitmap.width), static_cast<s32>(bitmap.rows) };
+    info.bearing = { face->glyph->bitmap_left, face->glyph->bitmap_top - (ascender - info.size.y) };
+    info.advance = { static_cast<s32>(face->glyph->advance.x >> 6), static_cast<s32>(face->glyph->advance.y >> 6) };
+    if (info.size.x == 0 or info.size.y == 0) {
+        return glyphs[index] = info;
+    }
+
+    // Glyphs are padded with empty texels, such that filtering never reads a neighbouring glyph
+    auto padded = info.size + 2 * PADDING;
+    glm::ivec2 position;
+    if (not pack(padded, info.page, position)) {
+        // Every page is in use by this frame, the glyph is skipped until a page becomes available again
+        info.page = -1;
+        info.size = { 0, 0 };
+        return info;
+    }
+
+    GlyphUpload upload{ info.page, position, padded, std::vector<u8>(static_cast<usize>(padded.x * padded.y), 0) };
+    for (s32 row = 0; row < info.size.y; ++row) {
+        const auto *source = bitmap.buffer + row * bitmap.pitch;
+        std::copy_n(source, info.size.x, upload.pixels.data() + (row + PADDING) * padded.x + PADDING);
+    }
+    uploads.push_back(std::move(upload));
+
+    info.texture_offset = glm::vec2{ position + PADDING } / static_cast<f32>(PAGE_SIZE);
+    info.texture_span = glm::vec2{ info.size } / static_cast<f32>(PAGE_SIZE);
+    pages[info.page].glyphs.push_back(index);
+    pages[info.page].last_used = frame;
+    return glyphs[index] = info;
+}
+
+/// Finds room for a rectangle within the pages, evicting the least recently used page if necessary
+bool GlyphCache::pack(glm::ivec2 size, s32 &page, glm::ivec2 &position) {
+    if (size.x > PAGE_SIZE or size.y > PAGE_SIZE) {
+        return false;
+    }
+
+    for (s32 i = 0; i < PAGE_COUNT; ++i) {
+        auto node = skyline_fit(pages[i].skyline, size, position);
+        if (node >= 0) {
+            skyline_insert(pages[i].skyline, static_cast<usize>(node), position, size);
+            page = i;
+            return true;
+        }
+    }
+
+    // Pages that the current frame uses cannot be evicted, as quads of this frame already sample them
+    s32 victim = -1;
+    for (s32 i = 0; i < PAGE_COUNT; ++i) {
+        if (pages[i].last_used < frame and (victim == -1 or pages[i].last_used < pages[victim].last_used)) {
+            victim = i;
+        }
+    }
+    if (victim == -1) {
+        return false;
+    }
+
+    std::fprintf(stdout, "[glyph] Evicting atlas page %d.\n", victim);
+    evict(victim);
+    auto node = skyline_fit(pages[victim].skyline, size, position);
+    skyline_insert(pages[victim].skyline, static_cast<usize>(node), position, size);
+    page = victim;
+    return true;
+}
+
+/// Evicts all glyphs of the specified page
+void GlyphCache::evict(s32 page) {
+    auto &target = pages[page];
+    for (auto index : target.glyphs) {
+        glyphs.erase(index);
+    }
+    target.glyphs.clear();
+    target.skyline.assign(1, SkylineNode{ 0, 0, PAGE_SIZE });
+    target.generation++;
 }
@@ -24,30 +24,193 @@
 #ifndef ENGINE_GLYPH_H
 #define ENGINE_GLYPH_H
 
-#include "texture.h"
 #include "types.h"
 
+#include <array>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct FT_LibraryRec_;
+struct FT_FaceRec_;
+struct hb_font_t;
+struct hb_buffer_t;
+
 struct GlyphInfo {
     glm::ivec2 size;
     glm::ivec2 bearing;
     glm::ivec2 advance;
+    glm::vec2 texture_offset;
     glm::vec2 texture_span;
-    f32 texture_offset;
+    s32 page;
 };
 
-struct GlyphCache {
-    Texture atlas;
-    GlyphInfo info[128];
+/// A glyph of a shaped run, the offset and advance are given in pixels at the font size of the cache
+struct ShapedGlyph {
+    u32 index;
+    glm::vec2 offset;
+    f32 advance;
+};
+
+/// A line of text shaped by HarfBuzz, its glyphs are in visual order and include kerning and ligatures
+struct ShapedRun {
+    std::string text;
+    std::vector<ShapedGlyph> glyphs;
+};
+
+/// How many lines were taken from the run cache and how many had to be shaped
+struct ShapeStats {
+    u32 run_hits;
+    u32 run_misses;
+};
+
+/// A segment of the skyline of an atlas page, the skyline is the upper edge of the glyphs packed so far
+struct SkylineNode {
+    s32 x;
+    s32 y;
+    s32 width;
+};
+
+/// A page of the glyph atlas, which is a layer of the atlas array texture, pages are evicted as a whole, such that
+/// glyphs never have to be moved within a page
+struct GlyphPage {
+    std::vector<SkylineNode> skyline;
+    std::vector<u32> glyphs;
+    u64 last_used;
+    u32 generation;
+};
 
+/// A rasterized glyph that still has to be uploaded into its page, which happens on the thread that owns the context
+struct GlyphUpload {
+    s32 page;
+    glm::ivec2 position;
+    glm::ivec2 size;
+    std::vector<u8> pixels;
+};
+
+/// Rasterizes glyphs on first use and packs them into the pages of a fixed-size atlas, once all pages are full the
+/// least recently used page that the current frame does not use is evicted, glyphs may be acquired by several
+/// threads at once
+struct GlyphCache {
     static inline constexpr auto FONT_SIZE = 24;
+    static inline constexpr s32 PAGE_SIZE = 1024;
+    static inline constexpr s32 PAGE_COUNT = 4;
+    static inline constexpr s32 PADDING = 1;
+    static inline constexpr usize RUN_MAX = 4096;
+
+    fs::path path;
+    std::string font;
+    FT_LibraryRec_ *library;
+    FT_FaceRec_ *face;
+    hb_font_t *shaper;
+    hb_buffer_t *buffer;
+    u32 font_id;
+    s32 ascender;
+    u32 atlas;
+    std::vector<GlyphPage> pages;
+    std::unordered_map<u32, u32> indices;
+    std::unordered_map<u32, GlyphInfo> glyphs;
+    std::vector<GlyphUpload> uploads;
+    std::mutex mutex;
+    u64 frame;
+
+    /// Shaped runs are keyed by the font, the font size and the hash of their text, the cache is emptied once it
+    /// holds RUN_MAX runs, the counters are guarded by the lock as well and only reset through reset_stats
+    std::unordered_map<u64, ShapedRun> runs;
+    u32 run_hits;
+    u32 run_misses;
 
-    /// Creates a glyph cache for the specified font
+    /// Creates a glyph cache for the specified font, which allocates all atlas pages up front
     explicit GlyphCache(const fs::path &path);
 
-    /// Fetches the specified symbol from the glyph cache
-    /// @param symbol The symbol that shall be fetched
-    /// @return The glyph info handle where the data is placed into
-    GlyphInfo &acquire(char symbol);
+    /// Destroys the font and the atlas
+    ~GlyphCache();
+
+    /// Replaces the font, all glyphs are rasterized again on their next use and the generation of every page changes
+    /// @param content The content of the font file
+    /// @return A boolean value that indicates whether the font could be loaded, the previous font is kept otherwise
+    bool reload(std::string content);
+
+    /// Fetches the glyph of the specified codepoint, which is rasterized on first use
+    /// @param codepoint The unicode codepoint
+    /// @return The glyph info, whose size is zero if the atlas has no room left for the current frame
+    GlyphInfo acquire(u32 codepoint);
+
+    /// Fetches the glyphs of the specified codepoints at once, which only locks the cache once
+    /// @param codepoints The unicode codepoints
+    /// @param infos The glyph infos, which are appended in the order of the codepoints
+    void acquire(std::span<const u32> codepoints, std::vector<GlyphInfo> &infos);
+
+    /// Shapes a line of UTF-8 text and fetches its glyphs, lines that were shaped before cost a single lookup
+    /// @param text The line of text
+    /// @param shaped The shaped glyphs, which are appended in visual order
+    /// @param infos The glyph infos, which are appended in the order of the shaped glyphs
+    void shape(std::string_view text, std::vector<ShapedGlyph> &shaped, std::vector<GlyphInfo> &infos);
+
+    /// Counts the glyphs that a line of UTF-8 text is shaped into, without fetching them
+    /// @param text The line of text
+    /// @return The number of shaped glyphs
+    u32 glyph_count(std::string_view text);
+
+    /// Retrieves the generations of the pages, which change whenever a page is evicted
+    /// @return The generations
+    std::array<u32, PAGE_COUNT> generations();
+
+    /// Marks the specified pages as used by the current frame, which protects them from eviction, unless a page was
+    /// evicted since the specified generations were retrieved
+    /// @param page_mask The bitmask of the pages
+    /// @param generations The generations of the pages
+    /// @return A boolean value that indicates whether the pages still hold the glyphs of the specified generations
+    bool touch(u32 page_mask, const std::array<u32, PAGE_COUNT> &generations);
+
+    /// Retrieves the counters of the run cache since they were last reset
+    /// @return The hits and misses
+    ShapeStats stats();
+
+    /// Resets the counters of the run cache, which may happen while other threads shape text
+    void reset_stats();
+
+    /// Uploads the glyphs that were rasterized since the last flush and begins the next frame, this has to be called
+    /// by the thread that owns the context before the glyphs are drawn
+    void flush();
+
+    /// Binds the atlas to the sampler at the specified slot
+    /// @param slot The sampler slot
+    void bind(u32 slot) const;
+
+private:
+    /// Fetches the glyph of the specified codepoint, the cache has to be locked
+    /// @param codepoint The unicode codepoint
+    /// @return The glyph info
+    GlyphInfo lookup(u32 codepoint);
+
+    /// Fetches the glyph of the specified glyph index, the cache has to be locked
+    /// @param index The glyph index within the font
+    /// @return The glyph info
+    GlyphInfo lookup_index(u32 index);
+
+    /// Retrieves the shaped run of a line of text, which is shaped on first use, the cache has to be locked
+    /// @param text The line of text
+    /// @return The shaped run
+    const ShapedRun &run(std::string_view text);
+
+    /// Rasterizes a glyph and packs it into a page, the cache has to be locked
+    /// @param index The glyph index within the font
+    /// @return The glyph info
+    GlyphInfo rasterize(u32 index);
+
+    /// Finds room for a rectangle within the pages, evicting the least recently used page if necessary
+    /// @param size The size of the rectangle
+    /// @param page The page that the rectangle was placed in
+    /// @param position The position of the rectangle within the page
+    /// @return A boolean value that indicates whether there was room for the rectangle
+    bool pack(glm::ivec2 size, s32 &page, glm::ivec2 &position);
+
+    /// Evicts all glyphs of the specified page, which changes its generation
+    /// @param page The page
+    void evict(s32 page);
 };
 
 #endif// ENGINE_GLYPH_H
@@ -0,0 +1,369 @@
+//
+// MIT License
+//
+// Copyright (c) 2024 Elias Engelbert Plank
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "job.h"
+
+#include <algorithm>
+
+namespace {
+
+/// The job system and worker index of the calling thread, which is only set for worker threads, such that several
+/// job systems do not overwrite each other's workers
+thread_local struct {
+    const JobSystem *system;
+    u32 index;
+} current_worker{ nullptr, 0 };
+
+/// Checks whether the dependency of a job is met, which is ordered against parking the job
+bool ready(const Job *job) {
+    return not job->dependency or job->dependency->value.load(std::memory_order_seq_cst) == 0;
+}
+
+}// namespace
+
+/// Creates an empty job queue
+JobQueue::JobQueue() : top(0), bottom(0), jobs() {
+}
+
+/// Pushes a job onto the bottom of the queue
+bool JobQueue::push(Job *job) {
+    auto b = bottom.load(std::memory_order_relaxed);
+    auto t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY) {
+        return false;
+    }
+
+    jobs[b & (CAPACITY - 1)].store(job, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+/// Pops the most recently pushed job from the bottom of the queue
+Job *JobQueue::pop() {
+    auto b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    auto *job = jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // This is the last job, hence we race against thieves for it
+        if (not top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+/// Steals the least recently pushed job from the top of the queue
+Job *JobQueue::steal() {
+    auto t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+        return nullptr;
+    }
+
+    auto *job = jobs[t & (CAPACITY - 1)].load(std::memory_order_acquire);
+    if (not top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return job;
+}
+
+/// Creates a job system, the thread that creates it is the main thread
+JobSystem::JobSystem(u32 threads)
+    : workers(),
+      pending(0),
+      sleeping(0),
+      running(true),
+      mutex(),
+      wake(),
+      parked(),
+      parked_count(0),
+      owner(std::this_thread::get_id()) {
+    for (u32 i = 0; i <= threads; ++i) {
+        auto &worker = workers.emplace_back(std::make_unique<JobWorker>());
+        worker->pool = std::make_unique<Job[]>(POOL_SIZE);
+        worker->pool_head = 0;
+        worker->random = i + 1;
+    }
+
+    for (u32 i = 1; i <= threads; ++i) {
+        workers[i]->thread = std::thread(&JobSystem::run, this, i);
+    }
+}
+
+/// Stops and joins all worker threads, then discards the jobs that are still queued or parked
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard lock(mutex);
+        running.store(false, std::memory_order_release);
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+
+    // No thread touches the queues anymore, pooled jobs go with their pool while heap jobs have to be deleted
+    auto discard = [](Job *job) {
+        if (job->heap) {
+            delete job;
+        } else {
+            job->function = nullptr;
+            job->pending.store(false, std::memory_order_relaxed);
+        }
+    };
+    for (auto &worker : workers) {
+        while (auto *job = worker->queue.pop()) {
+            discard(job);
+        }
+    }
+    for (auto *job : parked) {
+        discard(job);
+    }
+    parked.clear();
+    parked_count.store(0, std::memory_order_relaxed);
+    pending.store(0, std::memory_order_relaxed);
+}
+
+/// Submits a job
+void JobSystem::submit(std::function<void()> function, JobCounter *counter, const JobCounter *dependency) {
+    auto &worker = current();
+    auto *job = allocate(worker);
+    job->function = std::move(function);
+    job->counter = counter;
+    job->dependency = dependency;
+    job->pending.store(true, std::memory_order_relaxed);
+    if (counter) {
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    pending.fetch_add(1, std::memory_order_seq_cst);
+    push(worker, job);
+    notify();
+}
+
+/// Splits the range [0, count) into chunks, executes them in parallel and waits until all of them are finished
+void JobSystem::parallel_for(u32 count, u32 grain, const std::function<void(u32, u32)> &function) {
+    assert(grain > 0 and "[job] The grain size must not be zero!");
+    JobCounter counter;
+    for (u32 begin = 0; begin < count; begin += grain) {
+        auto end = std::min(count, begin + grain);
+        submit([&function, begin, end] { function(begin, end); }, &counter);
+    }
+    wait(counter);
+}
+
+/// Waits until the counter reaches zero, the waiting thread executes other jobs in the meantime
+void JobSystem::wait(const JobCounter &counter) {
+    auto &worker = current();
+    while (counter.value.load(std::memory_order_acquire) != 0) {
+        if (not execute(worker)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/// Retrieves the number of threads that execute jobs, including the main thread
+u32 JobSystem::concurrency() const {
+    return static_cast<u32>(workers.size());
+}
+
+/// Executes a single job of the calling thread or a job stolen from another thread
+bool JobSystem::execute(JobWorker &worker) {
+    // Jobs whose dependency is not met yet are parked, such that other jobs go first
+    auto *job = next(worker);
+    while (job and not ready(job)) {
+        if (not park(job)) {
+            break;
+        }
+        job = next(worker);
+    }
+    if (not job) {
+        return false;
+    }
+
+    pending.fetch_sub(1, std::memory_order_relaxed);
+    finish(job);
+    return true;
+}
+
+/// Pops a job of the calling thread or steals one from another thread
+Job *JobSystem::next(JobWorker &worker) {
+    if (auto *job = worker.queue.pop()) {
+        return job;
+    }
+
+    // Start at a random victim, such that idle threads do not all hammer the same queue
+    worker.random ^= worker.random << 13;
+    worker.random ^= worker.random >> 17;
+    worker.random ^= worker.random << 5;
+    auto start = worker.random % workers.size();
+    for (usize i = 0; i < workers.size(); ++i) {
+        auto &victim = *workers[(start + i) % workers.size()];
+        if (&victim == &worker) {
+            continue;
+        }
+        if (auto *job = victim.queue.steal()) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+/// Allocates a job from the pool of the calling thread, a slot is only reused once its previous job finished
+Job *JobSystem::allocate(JobWorker &worker) {
+    // Waiting for a slot could wait for a job further up the call stack, hence we never wait but skip busy slots
+    for (u32 i = 0; i < POOL_PROBES; ++i) {
+        auto *job = &worker.pool[worker.pool_head++ % POOL_SIZE];
+        if (not job->pending.load(std::memory_order_acquire)) {
+            job->heap = false;
+            return job;
+        }
+    }
+
+    auto *job = new Job{};
+    job->heap = true;
+    return job;
+}
+
+/// Pushes a job onto the queue of the calling thread, or executes it right away if the queue is full
+void JobSystem::push(JobWorker &worker, Job *job) {
+    if (worker.queue.push(job)) {
+        return;
+    }
+
+    if (job->dependency) {
+        wait(*job->dependency);
+    }
+    pending.fetch_sub(1, std::memory_order_relaxed);
+    finish(job);
+}
+
+/// Wakes a sleeping worker if there are any
+void JobSystem::notify() {
+    if (sleeping.load(std::memory_order_seq_cst) > 0) {
+        {
+            std::lock_guard lock(mutex);
+        }
+        wake.notify_one();
+    }
+}
+
+/// Executes the function of a job, marks it as finished and resumes the parked jobs once its counter reaches zero
+void JobSystem::finish(Job *job) {
+    job->function();
+    job->function = nullptr;
+
+    // The counter may be destroyed by a waiting thread as soon as it reaches zero, hence it is not touched afterwards
+    auto released = job->counter and job->counter->value.fetch_sub(1, std::memory_order_seq_cst) == 1;
+    if (job->heap) {
+        delete job;
+    } else {
+        job->pending.store(false, std::memory_order_release);
+    }
+    if (released and parked_count.load(std::memory_order_seq_cst) > 0) {
+        resume();
+    }
+}
+
+/// Parks a job whose dependency is not met
+bool JobSystem::park(Job *job) {
+    // A counter that reaches zero either sees the parked job or the job sees the counter at zero
+    std::lock_guard lock(mutex);
+    parked_count.fetch_add(1, std::memory_order_seq_cst);
+    if (ready(job)) {
+        parked_count.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    parked.push_back(job);
+    pending.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+/// Pushes the parked jobs whose dependency is met onto the queue of the calling thread
+void JobSystem::resume() {
+    std::vector<Job *> resumed;
+    {
+        std::lock_guard lock(mutex);
+        auto ready_jobs = std::ranges::partition(parked, [](const Job *job) { return not ready(job); });
+        resumed.assign(ready_jobs.begin(), ready_jobs.end());
+        parked.erase(ready_jobs.begin(), ready_jobs.end());
+        parked_count.fetch_sub(static_cast<u32>(resumed.size()), std::memory_order_relaxed);
+    }
+
+    // Pushing may execute a job right away, hence this happens without holding the lock
+    auto &worker = current();
+    for (auto *job : resumed) {
+        pending.fetch_add(1, std::memory_order_seq_cst);
+        push(worker, job);
+        notify();
+    }
+}
+
+/// Retrieves the worker of the calling thread, which is the first one for the main thread
+JobWorker &JobSystem::current() {
+    if (current_worker.system == this) {
+        return *workers[current_worker.index];
+    }
+    assert(std::this_thread::get_id() == owner and "[job] Jobs may only be used from the main thread or from jobs!");
+    return *workers[0];
+}
+
+/// The loop of every worker thread
+void JobSystem::run(u32 index) {
+    current_worker = { this, index };
+    auto &worker = *workers[index];
+
+    u32 idle = 0;
+    while (running.load(std::memory_order_acquire)) {
+        if (execute(worker)) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < SPIN_MAX) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // There is nothing to steal, hence the worker sleeps until a job is submitted
+        idle = 0;
+        sleeping.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [this] {
+                return pending.load(std::memory_order_seq_cst) > 0 or not running.load(std::memory_order_acquire);
+            });
+        }
+        sleeping.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
@@ -0,0 +1,170 @@
+//
+// MIT License
+//
+// Copyright (c) 2024 Elias Engelbert Plank
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef ENGINE_JOB_H
+#define ENGINE_JOB_H
+
+#include "types.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobCounter {
+    /// The number of submitted jobs that have not finished yet
+    std::atomic<u32> value{ 0 };
+};
+
+struct Job {
+    std::function<void()> function;
+    JobCounter *counter;
+    const JobCounter *dependency;
+    std::atomic<bool> pending;
+    bool heap;
+};
+
+/// Chase-Lev work-stealing deque, the owning thread pushes and pops at the bottom while other threads steal from the
+/// top, none of which takes a lock
+struct JobQueue {
+    constexpr static inline s64 CAPACITY = 4096;
+    alignas(64) std::atomic<s64> top;
+    alignas(64) std::atomic<s64> bottom;
+    std::array<std::atomic<Job *>, CAPACITY> jobs;
+
+    /// Creates an empty job queue
+    JobQueue();
+
+    /// Pushes a job onto the bottom of the queue, this may only be called by the owning thread
+    /// @param job The job
+    /// @return A boolean value that indicates whether the queue could hold the job
+    bool push(Job *job);
+
+    /// Pops the most recently pushed job from the bottom of the queue, this may only be called by the owning thread
+    /// @return The job or nullptr if the queue is empty
+    Job *pop();
+
+    /// Steals the least recently pushed job from the top of the queue, this may be called by any thread
+    /// @return The job or nullptr if the queue is empty or another thread won the race for the job
+    Job *steal();
+};
+
+struct JobWorker {
+    JobQueue queue;
+    std::unique_ptr<Job[]> pool;
+    u32 pool_head;
+    u32 random;
+    std::thread thread;
+};
+
+struct JobSystem {
+    std::vector<std::unique_ptr<JobWorker>> workers;
+    std::atomic<u32> pending;
+    std::atomic<u32> sleeping;
+    std::atomic<bool> running;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Job *> parked;
+    std::atomic<u32> parked_count;
+    std::thread::id owner;
+
+    constexpr static inline u32 POOL_SIZE = 4096;
+    constexpr static inline u32 POOL_PROBES = 8;
+    constexpr static inline u32 SPIN_MAX = 64;
+
+    /// Creates a job system, the thread that creates it is the main thread, which takes part in the work while it
+    /// waits for jobs
+    /// @param threads The number of worker threads besides the main thread
+    explicit JobSystem(u32 threads = std::max(std::thread::hardware_concurrency(), 1u) - 1);
+
+    /// Stops and joins all worker threads, pending jobs are discarded without decrementing their counters
+    ~JobSystem();
+
+    /// Submits a job, this may only be called by the main thread or from within a job, jobs whose dependency is not met
+    /// when they are taken are parked until a counter reaches zero and do not keep idle workers awake
+    /// @param function The function that the job executes
+    /// @param counter The counter that is incremented now and decremented once the job finishes
+    /// @param dependency The counter that has to reach zero before the job may start
+    void submit(std::function<void()> function, JobCounter *counter = nullptr, const JobCounter *dependency = nullptr);
+
+    /// Splits the range [0, count) into chunks, executes them in parallel and waits until all of them are finished
+    /// @param count The size of the range
+    /// @param grain The maximum number of elements per chunk
+    /// @param function The function that is called with the begin and end of each chunk
+    void parallel_for(u32 count, u32 grain, const std::function<void(u32, u32)> &function);
+
+    /// Waits until the counter reaches zero, the waiting thread executes other jobs in the meantime
+    /// @param counter The counter
+    void wait(const JobCounter &counter);
+
+    /// Retrieves the number of threads that execute jobs, including the main thread
+    /// @return The number of threads
+    u32 concurrency() const;
+
+private:
+    /// Executes a single job of the calling thread or a job stolen from another thread
+    /// @param worker The worker of the calling thread
+    /// @return A boolean value that indicates whether a job was executed
+    bool execute(JobWorker &worker);
+
+    /// Allocates a job from the pool of the calling thread, a slot is only reused once its previous job finished and
+    /// jobs are allocated on the heap if the next few slots are still in use
+    /// @param worker The worker of the calling thread
+    /// @return The job
+    Job *allocate(JobWorker &worker);
+
+    /// Pushes a job onto the queue of the calling thread, or executes it right away if the queue is full
+    void push(JobWorker &worker, Job *job);
+
+    /// Wakes a sleeping worker if there are any, such that pushing does not take a lock otherwise
+    void notify();
+
+    /// Executes the function of a job, marks it as finished and resumes the parked jobs once its counter reaches zero
+    void finish(Job *job);
+
+    /// Parks a job whose dependency is not met, such that it neither counts as pending nor occupies a queue
+    /// @param job The job
+    /// @return A boolean value that indicates whether the job was parked, which it is not if its dependency was met
+    /// in the meantime
+    bool park(Job *job);
+
+    /// Pushes the parked jobs whose dependency is met onto the queue of the calling thread
+    void resume();
+
+    /// Pops a job of the calling thread or steals one from another thread
+    /// @return The job or nullptr if no thread has any jobs left
+    Job *next(JobWorker &worker);
+
+    /// Retrieves the worker of the calling thread
+    JobWorker &current();
+
+    /// The loop of every worker thread
+    void run(u32 index);
+};
+
+#endif// ENGINE_JOB_H
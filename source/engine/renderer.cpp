@@ -22,180 +22,1479 @@
 // SOFTWARE.
 
 #include "renderer.h"
+#include "file.h"
+#include "job.h"
+#include "state.h"
+#include "watcher.h"
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <cstdio>
+#include <cstring>
 #include <glm/gtc/matrix_transform.hpp>
+#include <limits>
 #include <ranges>
 
+#if defined(__SSE2__) or defined(_M_X64)
+#define RENDERER_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define RENDERER_AVX2
+#include <immintrin.h>
+#endif
+
 namespace {
 
 constexpr auto WHITE = glm::vec4(1.0f);
+constexpr auto FULL_TEXTURE = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
 constexpr auto NO_TEXTURE = -1;
 
+/// Sort key layout from the most to the least significant bits:
+/// layer (8), pipeline (4), blend mode (4), texture (16), submission order (32)
+constexpr u32 KEY_LAYER_SHIFT = 56;
+constexpr u32 KEY_PIPELINE_SHIFT = 52;
+constexpr u32 KEY_BLEND_SHIFT = 48;
+constexpr u32 KEY_TEXTURE_SHIFT = 32;
+constexpr u64 KEY_TEXTURE_MASK = 0x0000'FFFF'0000'0000;
+constexpr u64 KEY_ORDER_MASK = 0xFFFF'FFFF;
+constexpr u64 KEY_BATCH_MASK = 0x00FF'0000'0000'0000;
+constexpr u64 KEY_STATE_MASK = 0x00FF'FFFF'0000'0000;
+
+/// Builds the sort key of a draw
+u64 sort_key(u8 layer, Pipeline pipeline, BlendMode blend, s32 texture, u32 order) {
+    assert(texture + 1 <= 0xFFFF and "[renderer] Too many textures in a single frame!");
+    return static_cast<u64>(layer) << KEY_LAYER_SHIFT | static_cast<u64>(pipeline) << KEY_PIPELINE_SHIFT |
+           static_cast<u64>(blend) << KEY_BLEND_SHIFT | static_cast<u64>(texture + 1) << KEY_TEXTURE_SHIFT | order;
+}
+
+/// Sorts the keys using a least significant digit radix sort, passes in which all keys share a digit are skipped
+void radix_sort(std::vector<u64> &keys, std::vector<u64> &scratch) {
+    if (std::ranges::is_sorted(keys)) {
+        return;
+    }
+
+    scratch.resize(keys.size());
+    auto *source = keys.data();
+    auto *target = scratch.data();
+    for (u32 shift = 0; shift < 64; shift += 8) {
+        std::array<usize, 256> offsets{};
+        for (usize i = 0; i < keys.size(); ++i) {
+            offsets[source[i] >> shift & 0xFF]++;
+        }
+        if (offsets[source[0] >> shift & 0xFF] == keys.size()) {
+            continue;
+        }
+
+        usize sum = 0;
+        for (auto &offset : offsets) {
+            auto count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for (usize i = 0; i < keys.size(); ++i) {
+            target[offsets[source[i] >> shift & 0xFF]++] = source[i];
+        }
+        std::swap(source, target);
+    }
+
+    if (source != keys.data()) {
+        std::memcpy(keys.data(), source, keys.size() * sizeof(u64));
+    }
+}
+
+/// Checks whether a key belongs to an opaque draw
+bool opaque(u64 key) {
+    return static_cast<BlendMode>(key >> KEY_BLEND_SHIFT & 0xF) == BlendMode::OPAQUE;
+}
+
+/// Moves the opaque draws of the sorted keys in front of all other draws in reverse order, such that they are drawn
+/// front to back, drawing the later draw first keeps it on top as the depth test rejects equal depths
+/// @return The number of opaque draws
+usize split_opaque(std::vector<u64> &keys, std::vector<u64> &scratch) {
+    if (std::ranges::none_of(keys, opaque)) {
+        return 0;
+    }
+
+    scratch.clear();
+    for (auto it = keys.rbegin(); it != keys.rend(); ++it) {
+        if (opaque(*it)) {
+            scratch.push_back(*it);
+        }
+    }
+    auto count = scratch.size();
+    for (auto key : keys) {
+        if (not opaque(key)) {
+            scratch.push_back(key);
+        }
+    }
+    keys.swap(scratch);
+    return count;
+}
+
+/// Retrieves the blend mode that a draw is recorded with, untextured draws without any transparency are opaque if
+/// the opaque pass of their layer is enabled
+BlendMode resolve_blend(BlendMode blend, Pipeline pipeline, const glm::u8vec4 &color, s32 texture, bool opaque_pass) {
+    if (not opaque_pass) {
+        return blend;
+    }
+    if (blend == BlendMode::ALPHA and pipeline != Pipeline::GLYPH and texture == NO_TEXTURE and color.a == 0xFF) {
+        return BlendMode::OPAQUE;
+    }
+    return blend;
+}
+
+/// Counts how often the masked bits change between consecutive keys
+u32 transitions(const std::vector<u64> &keys, u64 mask) {
+    u32 count = 0;
+    for (usize i = 1; i < keys.size(); ++i) {
+        count += (keys[i] & mask) != (keys[i - 1] & mask);
+    }
+    return count;
+}
+
+/// Packs a color into four normalized bytes
+glm::u8vec4 pack_color(const glm::vec4 &color) {
+#ifdef RENDERER_SSE2
+    // Adding one half before truncating rounds half away from zero just like glm::round for non-negative values
+    auto clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&color.x), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    auto integers = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+    auto shorts = _mm_packs_epi32(integers, integers);
+    auto bytes = _mm_packus_epi16(shorts, shorts);
+    auto packed = static_cast<u32>(_mm_cvtsi128_si32(bytes));
+    return glm::u8vec4{ static_cast<u8>(packed),
+                        static_cast<u8>(packed >> 8),
+                        static_cast<u8>(packed >> 16),
+                        static_cast<u8>(packed >> 24) };
+#else
+    return glm::u8vec4{ glm::round(glm::clamp(color, 0.0f, 1.0f) * 255.0f) };
+#endif
+}
+
+/// Packs a texture coordinate offset (xy) and span (zw) into four normalized shorts
+glm::u16vec4 pack_texture_rect(const glm::vec4 &texture_rect) {
+    return glm::u16vec4{ glm::round(glm::clamp(texture_rect, 0.0f, 1.0f) * 65535.0f) };
+}
+
+/// Checks whether a quad lies entirely outside of the bounds
+bool outside(const QuadExtent &ext, const glm::vec4 &bounds) {
+#ifdef RENDERER_SSE2
+    // The maximum (xy) of the quad is compared against the minimum of the bounds and the negated minimum (zw) of the
+    // quad against the negated maximum of the bounds, such that a single comparison covers all four sides
+    auto sign = _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f);
+    auto extent = _mm_loadu_ps(&ext.position.x);
+    auto rect = _mm_add_ps(extent, _mm_shuffle_ps(_mm_setzero_ps(), extent, _MM_SHUFFLE(1, 0, 1, 0)));
+    auto corners = _mm_shuffle_ps(rect, rect, _MM_SHUFFLE(1, 0, 3, 2));
+    auto limits = _mm_mul_ps(_mm_loadu_ps(&bounds.x), sign);
+    return _mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(corners, sign), limits)) != 0;
+#else
+    auto max = ext.position + ext.size;
+    return max.x <= bounds.x or max.y <= bounds.y or ext.position.x >= bounds.z or ext.position.y >= bounds.w;
+#endif
+}
+
+/// Writes the attributes that the corner vertices of a quad share or derive from its texture rect
+void expand_attributes(const glm::u8vec4 &color,
+                       const glm::u16vec4 &texture_rect,
+                       s16 texture_index,
+                       s16 texture_layer,
+                       Vertex *target) {
+    glm::u16vec2 uv_min{ texture_rect.x, texture_rect.y };
+    glm::u16vec2 uv_max;
+#ifdef RENDERER_SSE2
+    // The maximum uv is a saturated add, which clamps it to the texture just like the scalar path
+    auto rect = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&texture_rect));
+    auto packed = static_cast<u32>(_mm_cvtsi128_si32(_mm_adds_epu16(rect, _mm_srli_si128(rect, 4))));
+    uv_max = { static_cast<u16>(packed), static_cast<u16>(packed >> 16) };
+#else
+    uv_max = { static_cast<u16>(std::min(texture_rect.x + texture_rect.z, 0xFFFF)),
+               static_cast<u16>(std::min(texture_rect.y + texture_rect.w, 0xFFFF)) };
+#endif
+    target[0].texture_coordinates = { uv_min.x, uv_min.y };
+    target[1].texture_coordinates = { uv_min.x, uv_max.y };
+    target[2].texture_coordinates = { uv_max.x, uv_max.y };
+    target[3].texture_coordinates = { uv_max.x, uv_min.y };
+    for (u32 i = 0; i < 4; ++i) {
+        target[i].color = color;
+        target[i].texture_index = texture_index;
+        target[i].texture_layer = texture_layer;
+    }
+}
+
+/// Expands a quad into its four corner vertices, which are written to the target
+void expand(const Instance &quad, Vertex *target) {
+#ifdef RENDERER_SSE2
+    // The corners are shuffled out of the rect [min.x, min.y, max.x, max.y] and stored two at a time
+    auto extent = _mm_loadu_ps(&quad.position.x);
+    auto rect = _mm_add_ps(extent, _mm_shuffle_ps(_mm_setzero_ps(), extent, _MM_SHUFFLE(1, 0, 1, 0)));
+    auto left = _mm_shuffle_ps(rect, rect, _MM_SHUFFLE(3, 0, 1, 0));
+    auto right = _mm_shuffle_ps(rect, rect, _MM_SHUFFLE(1, 2, 3, 2));
+    _mm_storel_pi(reinterpret_cast<__m64 *>(&target[0].position), left);
+    _mm_storeh_pi(reinterpret_cast<__m64 *>(&target[1].position), left);
+    _mm_storel_pi(reinterpret_cast<__m64 *>(&target[2].position), right);
+    _mm_storeh_pi(reinterpret_cast<__m64 *>(&target[3].position), right);
+#else
+    auto min = quad.position;
+    auto max = quad.position + quad.size;
+    target[0].position = { min.x, min.y };
+    target[1].position = { min.x, max.y };
+    target[2].position = { max.x, max.y };
+    target[3].position = { max.x, min.y };
+#endif
+    expand_attributes(quad.color, quad.texture_rect, quad.texture_index, quad.texture_layer, target);
+}
+
+/// Expands a sprite into its four corner vertices, which are written to the target
+void expand(const Sprite &sprite, Vertex *target) {
+    target[0].position = sprite.origin;
+    target[1].position = sprite.origin + sprite.axis_y;
+    target[2].position = sprite.origin + sprite.axis_x + sprite.axis_y;
+    target[3].position = sprite.origin + sprite.axis_x;
+    expand_attributes(sprite.color, sprite.texture_rect, sprite.texture_index, sprite.texture_layer, target);
+}
+
+/// Rotates a sprite around its pivot, places the pivot at its position and applies the transform
+void place(const SpriteExtent &ext, const glm::mat3x2 &transform, Sprite &target) {
+    auto sine = std::sin(ext.rotation);
+    auto cosine = std::cos(ext.rotation);
+    auto axis_x = glm::vec2{ cosine, sine } * ext.size.x;
+    auto axis_y = glm::vec2{ -sine, cosine } * ext.size.y;
+    auto origin = ext.position - axis_x * ext.pivot.x - axis_y * ext.pivot.y;
+    target.origin = transform[0] * origin.x + transform[1] * origin.y + transform[2];
+    target.axis_x = transform[0] * axis_x.x + transform[1] * axis_x.y;
+    target.axis_y = transform[0] * axis_y.x + transform[1] * axis_y.y;
+}
+
+/// Checks whether the bounding box of a sprite lies entirely outside of the bounds
+bool outside(const Sprite &sprite, const glm::vec4 &bounds) {
+    auto zero = glm::vec2{ 0.0f };
+    auto min = sprite.origin + glm::min(sprite.axis_x, zero) + glm::min(sprite.axis_y, zero);
+    auto max = sprite.origin + glm::max(sprite.axis_x, zero) + glm::max(sprite.axis_y, zero);
+    return max.x <= bounds.x or max.y <= bounds.y or min.x >= bounds.z or min.y >= bounds.w;
+}
+
+#ifdef RENDERER_SSE2
+/// Computes the sine and cosine of four angles at once, the angles are reduced to [-pi/4, pi/4] around the nearest
+/// multiple of pi/2, whose quadrant selects and negates the minimax polynomials
+void sincos(__m128 angle, __m128 &sine, __m128 &cosine) {
+    auto quadrant = _mm_cvtps_epi32(_mm_mul_ps(angle, _mm_set1_ps(0.636619772f)));
+    auto multiple = _mm_cvtepi32_ps(quadrant);
+
+    // Pi/2 is subtracted in three parts, such that the reduced angle keeps its precision
+    auto x = _mm_sub_ps(angle, _mm_mul_ps(multiple, _mm_set1_ps(1.5703125f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(multiple, _mm_set1_ps(4.837512969970703125e-4f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(multiple, _mm_set1_ps(7.549789954891882e-8f)));
+    auto x2 = _mm_mul_ps(x, x);
+
+    auto s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), x2), _mm_set1_ps(8.3321608736e-3f));
+    s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.6666654611e-1f));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, x2), x), x);
+    auto c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), x2), _mm_set1_ps(-1.388731625493765e-3f));
+    c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(4.166664568298827e-2f));
+    c = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(c, x2), x2), _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(x2, _mm_set1_ps(0.5f))));
+
+    // Odd quadrants swap sine and cosine, the second bit of the quadrant flips the sign of the sine and the second
+    // bit of the next quadrant flips the sign of the cosine
+    auto one = _mm_set1_epi32(1);
+    auto two = _mm_set1_epi32(2);
+    auto swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+    auto sine_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+    auto cosine_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+    sine = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s)), sine_sign);
+    cosine = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c)), cosine_sign);
+}
+#endif
+
+/// Builds the indirect draw command for a range of quads, the first element is a vertex or instance index
+DrawElementsIndirectCommand quad_command(RenderMode mode, u32 first, u32 count) {
+    if (mode == RenderMode::INSTANCED) {
+        return DrawElementsIndirectCommand{ 6, count, 0, 0, first };
+    }
+    return DrawElementsIndirectCommand{ count * 6, 1, 0, static_cast<s32>(first), 0 };
+}
+
+/// Retrieves the vertex shader path for the specified render mode
+const char *vertex_shader(RenderMode mode) {
+    return mode == RenderMode::INSTANCED ? "assets/instance_vertex.glsl" : "assets/vertex.glsl";
+}
+
+/// Retrieves the sprite vertex shader path for the specified render mode, sprite vertices are quad vertices
+const char *sprite_vertex_shader(RenderMode mode) {
+    return mode == RenderMode::INSTANCED ? "assets/sprite_vertex.glsl" : "assets/vertex.glsl";
+}
+
+/// The declarations that all shaders of the renderer share
+constexpr auto SHADER_PRELUDE = "assets/prelude.glsl";
+
+/// Prefixes the shared shader declarations with the number of depths, every one of the 256 layers has two depth slots,
+/// one for its retained and one for its immediate draws
+std::string shader_prelude(std::string_view declarations) {
+    auto depths = std::to_string(256u * 2u * Renderer::DEPTH_SLOT_SIZE);
+    return "#define DEPTH_COUNT " + depths + "u\n#line 1\n" + std::string{ declarations };
+}
+
+/// Retrieves the quad fragment shader path, bindless textures are sampled through their resident handles
+const char *quad_fragment_shader(bool bindless) {
+    return bindless ? "assets/quad_bindless_fragment.glsl" : "assets/quad_fragment.glsl";
+}
+
+/// Generates the indices for the specified number of quads, every quad uses the pattern 0, 1, 2, 2, 0, 3
+std::vector<u32> quad_indices(u32 quads) {
+    std::vector<u32> indices(static_cast<usize>(quads) * 6);
+    for (u32 i = 0; i < quads; ++i) {
+        auto offset = i * 4;
+        auto *quad = indices.data() + static_cast<usize>(i) * 6;
+        quad[0] = offset + 0;
+        quad[1] = offset + 1;
+        quad[2] = offset + 2;
+        quad[3] = offset + 2;
+        quad[4] = offset + 0;
+        quad[5] = offset + 3;
+    }
+    return indices;
+}
+
 }// namespace
 
-/// Retrieves the layout of the vertex
+static_assert(sizeof(Vertex) == 20 and sizeof(Instance) == 32, "[renderer] Unexpected padding in packed vertices!");
+static_assert(sizeof(QuadExtent) == 16 and sizeof(glm::vec4) == 16, "[renderer] Quads are loaded as a single vector!");
+static_assert(sizeof(Sprite) == 40, "[renderer] Unexpected padding in packed sprites!");
+
+/// Retrieves the layout of the vertex, the texture index and layer are fetched as a single attribute
 VertexBufferLayout Vertex::layout() {
-    return { ShaderType::FLOAT2, ShaderType::FLOAT4, ShaderType::FLOAT2, ShaderType::INT };
+    return { ShaderType::FLOAT2, ShaderType::UBYTE4_NORM, ShaderType::USHORT2_NORM, ShaderType::SHORT2 };
+}
+
+/// Retrieves the layout of the instance, the texture index and layer are fetched as a single attribute
+VertexBufferLayout Instance::layout() {
+    return { ShaderType::FLOAT2,       ShaderType::FLOAT2, ShaderType::UBYTE4_NORM,
+             ShaderType::USHORT4_NORM, ShaderType::SHORT2 };
+}
+
+/// Retrieves the layout of the sprite, the texture index and layer are fetched as a single attribute
+VertexBufferLayout Sprite::layout() {
+    return { ShaderType::FLOAT2,      ShaderType::FLOAT2,       ShaderType::FLOAT2,
+             ShaderType::UBYTE4_NORM, ShaderType::USHORT4_NORM, ShaderType::SHORT2 };
 }
 
 /// Creates a new render group
-RenderGroup::RenderGroup(const fs::path &vertex, const fs::path &fragment)
-    : commands(),
-      vertex_array(),
-      vertex_buffer(),
-      index_buffer(),
-      shader(vertex, fragment) {
-    vertex_buffer.layout = std::move(Vertex::layout());
-    vertex_array.submit(&vertex_buffer);
-    vertex_array.submit(&index_buffer);
+RenderGroup::RenderGroup(const fs::path &vertex,
+                         const fs::path &fragment,
+                         RenderMode mode,
+                         ProgramCache *programs,
+                         std::string prelude,
+                         usize instance_stride,
+                         const VertexBufferLayout &instance_layout)
+    : vertex_array(),
+      vertex_buffer(REGION_QUADS * (mode == RenderMode::INSTANCED ? instance_stride : 4 * sizeof(Vertex))),
+      shader(vertex, fragment, programs, std::move(prelude)),
+      mode(mode),
+      stride(mode == RenderMode::INSTANCED ? instance_stride : sizeof(Vertex)),
+      first(0),
+      count(0),
+      overflow(false),
+      pending_quads(),
+      pending_sprites() {
+    vertex_buffer.layout = mode == RenderMode::INSTANCED ? instance_layout : Vertex::layout();
+    submit();
 }
 
-/// Clears the specified render group (i.e. deletes the commands)
+/// Clears the specified render group, the next batch starts at the current position of the vertex stream
 void RenderGroup::clear() {
-    commands = {};
+    first = static_cast<u32>(vertex_buffer.offset() / stride);
+    count = 0;
+}
+
+/// Doubles the size of the stream regions
+void RenderGroup::grow() {
+    vertex_buffer.resize(vertex_buffer.region_size * 2);
+    submit();
+    overflow = false;
+}
+
+/// Writes a quad into the mapped stream of the render group, in vertex mode it is expanded right within the stream
+bool RenderGroup::push(const Instance &instance, bool defer) {
+    auto *target = vertex_buffer.map(mode == RenderMode::INSTANCED ? sizeof(instance) : 4 * sizeof(Vertex));
+    if (not target) {
+        return false;
+    }
+    if (mode == RenderMode::INSTANCED) {
+        std::memcpy(target, &instance, sizeof(instance));
+    } else if (defer) {
+        pending_quads.emplace_back(static_cast<Vertex *>(target), instance);
+    } else {
+        expand(instance, static_cast<Vertex *>(target));
+    }
+    count++;
+    return true;
+}
+
+/// Writes a sprite into the mapped stream of the render group, in vertex mode it is expanded right within the stream
+bool RenderGroup::push(const Sprite &sprite, bool defer) {
+    auto *target = vertex_buffer.map(mode == RenderMode::INSTANCED ? sizeof(sprite) : 4 * sizeof(Vertex));
+    if (not target) {
+        return false;
+    }
+    if (mode == RenderMode::INSTANCED) {
+        std::memcpy(target, &sprite, sizeof(sprite));
+    } else if (defer) {
+        pending_sprites.emplace_back(static_cast<Vertex *>(target), sprite);
+    } else {
+        expand(sprite, static_cast<Vertex *>(target));
+    }
+    count++;
+    return true;
+}
+
+/// Expands the deferred quads and sprites into the vertices that they reserved, every job expands a disjoint range
+void RenderGroup::expand_pending(JobSystem &jobs) {
+    jobs.parallel_for(static_cast<u32>(pending_quads.size()), EXPAND_GRAIN, [this](u32 begin, u32 end) {
+        for (auto i = begin; i < end; i++) {
+            expand(pending_quads[i].second, pending_quads[i].first);
+        }
+    });
+    jobs.parallel_for(static_cast<u32>(pending_sprites.size()), EXPAND_GRAIN, [this](u32 begin, u32 end) {
+        for (auto i = begin; i < end; i++) {
+            expand(pending_sprites[i].second, pending_sprites[i].first);
+        }
+    });
+    pending_quads.clear();
+    pending_sprites.clear();
+}
+
+/// Checks whether the render group contains any quads
+bool RenderGroup::empty() const {
+    return count == 0;
+}
+
+/// Submits the stream buffer to the vertex array, instance attributes start after the unit quad corner
+void RenderGroup::submit() {
+    if (mode == RenderMode::INSTANCED) {
+        vertex_array.submit(&vertex_buffer, 1, 1);
+    } else {
+        vertex_array.submit(&vertex_buffer);
+    }
+}
+
+/// Creates an empty command buffer
+CommandBuffer::CommandBuffer()
+    : layer(0),
+      blend(BlendMode::ALPHA),
+      opaque_layers(),
+      bounds(0.0f),
+      bindless(false),
+      cache(nullptr),
+      culled(0),
+      glyph_pages(0),
+      keys(),
+      quads(),
+      sprites(),
+      textures(),
+      texture_handles(),
+      texture_layered(),
+      resident_handles(),
+      expanded(),
+      shaped_glyphs(),
+      glyph_infos() {
+}
+
+/// Records a colored quad
+void CommandBuffer::draw_quad(const QuadExtent &ext, const glm::vec4 &color) {
+    record(Pipeline::QUAD, ext, color, FULL_TEXTURE, NO_TEXTURE, NO_TEXTURE);
 }
 
-/// Pushes a set of vertices and indices to the render group
-void RenderGroup::push(const RenderCommand &command) {
-    commands.emplace_back(command);
+/// Records a textured quad
+void CommandBuffer::draw_quad(const QuadExtent &ext, const Texture &texture) {
+    auto index = texture_index(texture.handle, texture.resident_handle, false);
+    record(Pipeline::QUAD, ext, WHITE, FULL_TEXTURE, index, NO_TEXTURE);
+}
+
+/// Records a quad that is textured with a layer of an array texture
+void CommandBuffer::draw_quad(const QuadExtent &ext, const TextureLayer &texture) {
+    auto index = texture_index(texture.array->handle, texture.array->resident_handle, true);
+    record(Pipeline::QUAD, ext, WHITE, FULL_TEXTURE, index, texture.layer);
+}
+
+/// Records colored quads in a single pass
+void CommandBuffer::draw_quads(std::span<const QuadExtent> exts, std::span<const glm::vec4> colors) {
+    record(Pipeline::QUAD, exts, colors, FULL_TEXTURE, NO_TEXTURE, NO_TEXTURE);
+}
+
+/// Records quads that are textured with the same texture in a single pass
+void CommandBuffer::draw_quads(std::span<const QuadExtent> exts, const Texture &texture) {
+    auto index = texture_index(texture.handle, texture.resident_handle, false);
+    record(Pipeline::QUAD, exts, { &WHITE, 1 }, FULL_TEXTURE, index, NO_TEXTURE);
+}
+
+/// Records quads that are textured with the same layer of an array texture in a single pass
+void CommandBuffer::draw_quads(std::span<const QuadExtent> exts, const TextureLayer &texture) {
+    auto index = texture_index(texture.array->handle, texture.array->resident_handle, true);
+    record(Pipeline::QUAD, exts, { &WHITE, 1 }, FULL_TEXTURE, index, texture.layer);
+}
+
+/// Records a colored sprite
+void CommandBuffer::draw_sprite(const SpriteExtent &ext, const glm::vec4 &color, const glm::mat3x2 &transform) {
+    record({ &ext, 1 }, { &color, 1 }, transform, NO_TEXTURE, NO_TEXTURE);
+}
+
+/// Records a textured sprite
+void CommandBuffer::draw_sprite(const SpriteExtent &ext, const Texture &texture, const glm::mat3x2 &transform) {
+    auto index = texture_index(texture.handle, texture.resident_handle, false);
+    record({ &ext, 1 }, { &WHITE, 1 }, transform, index, NO_TEXTURE);
+}
+
+/// Records a sprite that is textured with a layer of an array texture
+void CommandBuffer::draw_sprite(const SpriteExtent &ext, const TextureLayer &texture, const glm::mat3x2 &transform) {
+    auto index = texture_index(texture.array->handle, texture.array->resident_handle, true);
+    record({ &ext, 1 }, { &WHITE, 1 }, transform, index, texture.layer);
+}
+
+/// Records colored sprites in a single pass
+void CommandBuffer::draw_sprites(std::span<const SpriteExtent> exts,
+                                 std::span<const glm::vec4> colors,
+                                 const glm::mat3x2 &transform) {
+    record(exts, colors, transform, NO_TEXTURE, NO_TEXTURE);
+}
+
+/// Records sprites that are textured with the same texture in a single pass
+void CommandBuffer::draw_sprites(std::span<const SpriteExtent> exts,
+                                 const Texture &texture,
+                                 const glm::mat3x2 &transform) {
+    auto index = texture_index(texture.handle, texture.resident_handle, false);
+    record(exts, { &WHITE, 1 }, transform, index, NO_TEXTURE);
+}
+
+/// Records sprites that are textured with the same layer of an array texture in a single pass
+void CommandBuffer::draw_sprites(std::span<const SpriteExtent> exts,
+                                 const TextureLayer &texture,
+                                 const glm::mat3x2 &transform) {
+    auto index = texture_index(texture.array->handle, texture.array->resident_handle, true);
+    record(exts, { &WHITE, 1 }, transform, index, texture.layer);
+}
+
+/// Records a symbol
+void CommandBuffer::draw_symbol(const SymbolExtent &ext, const glm::vec4 &color, const GlyphInfo &glyph) {
+    // Glyphs without pixels, such as spaces, only advance the text
+    if (glyph.page < 0) {
+        return;
+    }
+
+    // The page of the glyph is the layer of the atlas array texture
+    auto scale = ext.size / GlyphCache::FONT_SIZE;
+    auto scaled_size = glm::vec2{ glyph.size } * scale;
+    auto scaled_position = glm::vec2{ ext.position.x + static_cast<f32>(glyph.bearing.x) * scale,
+                                      ext.position.y + static_cast<f32>(glyph.size.y - glyph.bearing.y) * scale };
+    auto texture_rect =
+        glm::vec4{ glyph.texture_offset.x, glyph.texture_offset.y, glyph.texture_span.x, glyph.texture_span.y };
+    glyph_pages |= 1u << glyph.page;
+    record(Pipeline::GLYPH, { scaled_position, scaled_size }, color, texture_rect, NO_TEXTURE, glyph.page);
+}
+
+/// Records text
+void CommandBuffer::draw_text(const TextExtent &ext, const glm::vec4 &color, std::string_view text) {
+    auto scale = ext.size / GlyphCache::FONT_SIZE;
+    auto iterator = ext.position;
+
+    for (usize start = 0; start < text.size();) {
+        auto end = std::min(text.find('\n', start), text.size());
+        auto line = text.substr(start, end - start);
+        start = end + 1;
+
+        // Tabs are drawn as four spaces, hence they are expanded before the line is shaped
+        if (line.find('\t') != std::string_view::npos) {
+            expanded.clear();
+            for (auto ch : line) {
+                expanded.append(ch == '\t' ? 4 : 1, ch == '\t' ? ' ' : ch);
+            }
+            line = expanded;
+        }
+
+        // Glyphs never extend further than twice the text size from their line, hence whole lines are culled at once,
+        // they count the glyphs that the line is shaped into, which ligatures and combining marks set apart from its
+        // codepoints
+        if (iterator.y + 2.0f * ext.size <= bounds.y or iterator.y - 2.0f * ext.size >= bounds.w) {
+            culled += cache->glyph_count(line);
+        } else {
+            // The line is shaped and its glyphs are fetched at once, such that threads that record text rarely
+            // contend for the cache
+            shaped_glyphs.clear();
+            glyph_infos.clear();
+            cache->shape(line, shaped_glyphs, glyph_infos);
+
+            for (usize i = 0; i < glyph_infos.size(); ++i) {
+                // Glyphs only advance to the right, hence the rest of the line is culled as well
+                if (iterator.x - ext.size >= bounds.z) {
+                    culled += static_cast<u32>(glyph_infos.size() - i);
+                    break;
+                }
+                const auto &shaped = shaped_glyphs[i];
+                draw_symbol({ iterator + shaped.offset * scale, ext.size }, color, glyph_infos[i]);
+                iterator.x += shaped.advance * scale;
+            }
+        }
+
+        iterator.x = ext.position.x;
+        iterator.y += ext.size;
+    }
+}
+
+/// Records a quad unless it lies entirely outside of the bounds
+void CommandBuffer::record(Pipeline pipeline,
+                           const QuadExtent &ext,
+                           const glm::vec4 &color,
+                           const glm::vec4 &texture_rect,
+                           s32 texture,
+                           s32 texture_layer) {
+    if (outside(ext, bounds)) {
+        culled++;
+        return;
+    }
+
+    // Bindless textures do not need to be bound, hence they are no state that draws need to be sorted by
+    auto order = static_cast<u32>(quads.size());
+    auto packed_color = pack_color(color);
+    auto blend_mode = resolve_blend(blend, pipeline, packed_color, texture, opaque_layers[layer]);
+    keys.push_back(sort_key(layer, pipeline, blend_mode, bindless ? NO_TEXTURE : texture, order));
+    quads.push_back(Instance{ ext.position, ext.size, packed_color, pack_texture_rect(texture_rect),
+                              static_cast<s16>(texture), static_cast<s16>(texture_layer) });
+}
+
+/// Records quads that share their pipeline and texture
+void CommandBuffer::record(Pipeline pipeline,
+                           std::span<const QuadExtent> exts,
+                           std::span<const glm::vec4> colors,
+                           const glm::vec4 &texture_rect,
+                           s32 texture,
+                           s32 texture_layer) {
+    if (exts.empty()) {
+        return;
+    }
+    assert((colors.size() == exts.size() or colors.size() == 1) and "[renderer] Every quad needs a color!");
+
+    // Visible quads are appended without reallocating, culled quads are never written
+    auto first = quads.size();
+    keys.reserve(first + exts.size());
+    quads.reserve(first + exts.size());
+    auto texture_key = bindless ? NO_TEXTURE : texture;
+    auto key = sort_key(layer, pipeline, blend, texture_key, 0);
+    auto opaque_blend = resolve_blend(blend, pipeline, glm::u8vec4{ 0xFF }, texture, opaque_layers[layer]);
+    auto opaque_key = sort_key(layer, pipeline, opaque_blend, texture_key, 0);
+    auto append = [&](const Instance &quad) {
+        keys.push_back((quad.color.a == 0xFF ? opaque_key : key) | quads.size());
+        quads.push_back(quad);
+    };
+    auto shared = Instance{ {},
+                            {},
+                            pack_color(colors[0]),
+                            pack_texture_rect(texture_rect),
+                            static_cast<s16>(texture),
+                            static_cast<s16>(texture_layer) };
+    auto shared_color = colors.size() == 1;
+
+    usize i = 0;
+#ifdef RENDERER_AVX2
+    // Two quads fit into a single register, every instance is the extent followed by the shared attributes and color
+    auto sign = _mm256_setr_ps(1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, -1.0f);
+    auto limits = _mm256_mul_ps(_mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&bounds.x)), sign);
+    auto tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&shared.color));
+    auto color_pair = _mm256_set1_epi32(_mm_cvtsi128_si32(tail));
+    for (; i + 2 <= exts.size(); i += 2) {
+        auto extents = _mm256_loadu_ps(&exts[i].position.x);
+        auto rects = _mm256_add_ps(extents, _mm256_shuffle_ps(_mm256_setzero_ps(), extents, _MM_SHUFFLE(1, 0, 1, 0)));
+        auto corners = _mm256_permute_ps(rects, _MM_SHUFFLE(1, 0, 3, 2));
+        auto outside_mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_mul_ps(corners, sign), limits, _CMP_LE_OQ));
+
+        if (not shared_color) {
+            auto clamped = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(&colors[i].x), _mm256_setzero_ps()),
+                                         _mm256_set1_ps(1.0f));
+            auto scaled = _mm256_add_ps(_mm256_mul_ps(clamped, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f));
+            auto integers = _mm256_cvttps_epi32(scaled);
+            auto shorts = _mm256_packs_epi32(integers, integers);
+            color_pair = _mm256_packus_epi16(shorts, shorts);
+        }
+
+        auto extent_bits = _mm256_castps_si256(extents);
+        auto first_tail = _mm_insert_epi32(tail, _mm256_extract_epi32(color_pair, 0), 0);
+        auto second_tail = _mm_insert_epi32(tail, _mm256_extract_epi32(color_pair, 4), 0);
+        std::array<Instance, 2> pair;
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&pair[0]), _mm256_inserti128_si256(extent_bits, first_tail, 1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&pair[1]),
+                            _mm256_set_m128i(second_tail, _mm256_extracti128_si256(extent_bits, 1)));
+        if ((outside_mask & 0x0F) == 0) {
+            append(pair[0]);
+        }
+        if ((outside_mask & 0xF0) == 0) {
+            append(pair[1]);
+        }
+    }
+#endif
+    for (; i < exts.size(); ++i) {
+        if (outside(exts[i], bounds)) {
+            continue;
+        }
+        auto quad = shared;
+        quad.position = exts[i].position;
+        quad.size = exts[i].size;
+        if (not shared_color) {
+            quad.color = pack_color(colors[i]);
+        }
+        append(quad);
+    }
+
+    culled += static_cast<u32>(first + exts.size() - quads.size());
+}
+
+/// Transforms and records sprites that share their texture
+void CommandBuffer::record(std::span<const SpriteExtent> exts,
+                           std::span<const glm::vec4> colors,
+                           const glm::mat3x2 &transform,
+                           s32 texture,
+                           s32 texture_layer) {
+    if (exts.empty()) {
+        return;
+    }
+    assert((colors.size() == exts.size() or colors.size() == 1) and "[renderer] Every sprite needs a color!");
+
+    auto first = sprites.size();
+    keys.reserve(first + exts.size());
+    sprites.reserve(first + exts.size());
+    auto texture_key = bindless ? NO_TEXTURE : texture;
+    auto key = sort_key(layer, Pipeline::SPRITE, blend, texture_key, 0);
+    auto opaque_blend = resolve_blend(blend, Pipeline::SPRITE, glm::u8vec4{ 0xFF }, texture, opaque_layers[layer]);
+    auto opaque_key = sort_key(layer, Pipeline::SPRITE, opaque_blend, texture_key, 0);
+    auto shared = Sprite{ {},
+                          {},
+                          {},
+                          pack_color(colors[0]),
+                          pack_texture_rect(FULL_TEXTURE),
+                          static_cast<s16>(texture),
+                          static_cast<s16>(texture_layer) };
+    auto append = [&](usize i, Sprite &sprite) {
+        if (colors.size() > 1) {
+            sprite.color = pack_color(colors[i]);
+        }
+        keys.push_back((sprite.color.a == 0xFF ? opaque_key : key) | sprites.size());
+        sprites.push_back(sprite);
+    };
+
+    usize i = 0;
+#ifdef RENDERER_SSE2
+    // Four sprites are transformed at a time with every lane holding one sprite, hence the extents are transposed
+    // into one register per component and the results are transposed back into the sprites
+    auto column = [](const glm::vec2 &v) {
+        return std::pair{ _mm_set1_ps(v.x), _mm_set1_ps(v.y) };
+    };
+    auto [m00, m01] = column(transform[0]);
+    auto [m10, m11] = column(transform[1]);
+    auto [m20, m21] = column(transform[2]);
+    auto zero = _mm_setzero_ps();
+    auto bounds_x = _mm_set1_ps(bounds.x);
+    auto bounds_y = _mm_set1_ps(bounds.y);
+    auto bounds_z = _mm_set1_ps(bounds.z);
+    auto bounds_w = _mm_set1_ps(bounds.w);
+    for (; i + 4 <= exts.size(); i += 4) {
+        alignas(16) std::array<std::array<f32, 4>, 7> lanes;
+        for (u32 lane = 0; lane < 4; ++lane) {
+            const auto &ext = exts[i + lane];
+            lanes[0][lane] = ext.position.x;
+            lanes[1][lane] = ext.position.y;
+            lanes[2][lane] = ext.size.x;
+            lanes[3][lane] = ext.size.y;
+            lanes[4][lane] = ext.rotation;
+            lanes[5][lane] = ext.pivot.x;
+            lanes[6][lane] = ext.pivot.y;
+        }
+        auto size_x = _mm_load_ps(lanes[2].data());
+        auto size_y = _mm_load_ps(lanes[3].data());
+        auto pivot_x = _mm_load_ps(lanes[5].data());
+        auto pivot_y = _mm_load_ps(lanes[6].data());
+        __m128 sine;
+        __m128 cosine;
+        sincos(_mm_load_ps(lanes[4].data()), sine, cosine);
+
+        // Rotate the axes and move the origin such that the pivot lies at the position
+        auto axis_x_x = _mm_mul_ps(size_x, cosine);
+        auto axis_x_y = _mm_mul_ps(size_x, sine);
+        auto axis_y_x = _mm_sub_ps(zero, _mm_mul_ps(size_y, sine));
+        auto axis_y_y = _mm_mul_ps(size_y, cosine);
+        auto origin_x = _mm_sub_ps(_mm_load_ps(lanes[0].data()),
+                                   _mm_add_ps(_mm_mul_ps(pivot_x, axis_x_x), _mm_mul_ps(pivot_y, axis_y_x)));
+        auto origin_y = _mm_sub_ps(_mm_load_ps(lanes[1].data()),
+                                   _mm_add_ps(_mm_mul_ps(pivot_x, axis_x_y), _mm_mul_ps(pivot_y, axis_y_y)));
+
+        // Apply the transform, axes are directions and hence not translated
+        auto linear_x = [&](__m128 x, __m128 y) {
+            return _mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y));
+        };
+        auto linear_y = [&](__m128 x, __m128 y) {
+            return _mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y));
+        };
+        __m128 results[] = { _mm_add_ps(linear_x(origin_x, origin_y), m20),
+                             _mm_add_ps(linear_y(origin_x, origin_y), m21),
+                             linear_x(axis_x_x, axis_x_y),
+                             linear_y(axis_x_x, axis_x_y),
+                             linear_x(axis_y_x, axis_y_y),
+                             linear_y(axis_y_x, axis_y_y) };
+
+        // Cull the bounding boxes, the axes only extend the box into the direction they point to
+        auto min_x = _mm_add_ps(results[0], _mm_add_ps(_mm_min_ps(results[2], zero), _mm_min_ps(results[4], zero)));
+        auto min_y = _mm_add_ps(results[1], _mm_add_ps(_mm_min_ps(results[3], zero), _mm_min_ps(results[5], zero)));
+        auto max_x = _mm_add_ps(results[0], _mm_add_ps(_mm_max_ps(results[2], zero), _mm_max_ps(results[4], zero)));
+        auto max_y = _mm_add_ps(results[1], _mm_add_ps(_mm_max_ps(results[3], zero), _mm_max_ps(results[5], zero)));
+        auto outside_x = _mm_or_ps(_mm_cmple_ps(max_x, bounds_x), _mm_cmpge_ps(min_x, bounds_z));
+        auto outside_y = _mm_or_ps(_mm_cmple_ps(max_y, bounds_y), _mm_cmpge_ps(min_y, bounds_w));
+        auto outside_mask = _mm_movemask_ps(_mm_or_ps(outside_x, outside_y));
+
+        alignas(16) std::array<std::array<f32, 4>, 6> placed;
+        for (usize component = 0; component < placed.size(); ++component) {
+            _mm_store_ps(placed[component].data(), results[component]);
+        }
+        for (u32 lane = 0; lane < 4; ++lane) {
+            if (outside_mask & 1 << lane) {
+                continue;
+            }
+            auto sprite = shared;
+            sprite.origin = { placed[0][lane], placed[1][lane] };
+            sprite.axis_x = { placed[2][lane], placed[3][lane] };
+            sprite.axis_y = { placed[4][lane], placed[5][lane] };
+            append(i + lane, sprite);
+        }
+    }
+#endif
+    for (; i < exts.size(); ++i) {
+        auto sprite = shared;
+        place(exts[i], transform, sprite);
+        if (not outside(sprite, bounds)) {
+            append(i, sprite);
+        }
+    }
+
+    culled += static_cast<u32>(first + exts.size() - sprites.size());
+}
+
+/// Retrieves the recording-local index of a texture, textures that are used for the first time are assigned the next
+/// free index
+s32 CommandBuffer::texture_index(u32 handle, u64 resident_handle, bool layered) {
+    if (auto it = textures.find(handle); it != textures.end()) {
+        return it->second;
+    }
+
+    auto index = static_cast<s32>(texture_handles.size());
+    assert(index < INT16_MAX and "[renderer] Too many textures in a single frame!");
+    textures[handle] = index;
+    texture_handles.push_back(handle);
+    texture_layered.push_back(layered);
+    if (bindless) {
+        assert(resident_handle and "[renderer] Texture is not resident!");
+        resident_handles.push_back(resident_handle);
+    }
+    return index;
+}
+
+/// Clears all recorded draws and textures
+void CommandBuffer::clear() {
+    keys.clear();
+    quads.clear();
+    sprites.clear();
+    textures.clear();
+    texture_handles.clear();
+    texture_layered.clear();
+    resident_handles.clear();
+    culled = 0;
+    glyph_pages = 0;
+}
+
+/// Creates a new retained layer, which is dirty until it is recorded for the first time
+RenderLayer::RenderLayer()
+    : commands(),
+      vertex_array(),
+      vertex_buffer(),
+      sprite_array(),
+      sprite_buffer(),
+      indirect_buffer(),
+      draw_buffer(),
+      texture_buffer(),
+      batches(),
+      quads(0),
+      dirty(true),
+      glyph_generations() {
+}
+
+/// Marks the layer as changed, such that its owner records it again
+void RenderLayer::invalidate() {
+    dirty = true;
 }
 
 /// Creates a new renderer
-Renderer::Renderer()
+Renderer::Renderer(RenderMode mode)
     : cache("assets/cmu-serif-roman.ttf"),
-      glyph_group("assets/vertex.glsl", "assets/glyph_fragment.glsl"),
-      quad_group("assets/vertex.glsl", "assets/quad_fragment.glsl"),
-      transform(1.0f) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      mode(mode),
+      bindless(GLAD_GL_ARB_bindless_texture != 0),
+      index_buffer(),
+      unit_quad(),
+      programs(),
+      prelude(shader_prelude(File::read(SHADER_PRELUDE).value_or(std::string{}))),
+      glyph_group(vertex_shader(mode), "assets/glyph_fragment.glsl", mode, &programs, prelude),
+      quad_group(vertex_shader(mode), quad_fragment_shader(bindless), mode, &programs, prelude),
+      sprite_group(sprite_vertex_shader(mode),
+                   quad_fragment_shader(bindless),
+                   mode,
+                   &programs,
+                   prelude,
+                   sizeof(Sprite),
+                   Sprite::layout()),
+      transform(1.0f),
+      stats(),
+      start(std::chrono::steady_clock::now()),
+      frame_buffer(),
+      batch_buffer(),
+      batch_data(),
+      batch_stride(0),
+      viewport(0.0f),
+      frame(),
+      thread_commands(),
+      thread_count(0),
+      jobs(nullptr),
+      batch(),
+      texture_buffer(),
+      draw_parameters(GLAD_GL_ARB_shader_draw_parameters != 0),
+      indirect_buffer(),
+      draw_buffer(),
+      recording_layer(nullptr),
+      layer(0),
+      blend(BlendMode::ALPHA),
+      opaque_layers(),
+      clip(),
+      state_changed(true) {
+    auto &state = GLStateCache::current();
+    state.enable_blend(true);
+    state.blend_function(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // Configure quad texture slots
-    for (auto i = s32{ 0 }; i < TEXTURE_MAX; ++i) {
-        auto name = std::format("uniform_textures[{}]", i);
-        quad_group.shader.uniform(name.c_str(), i + TEXTURE_START);
+    // Start compiling the variants that draws select up front, such that the first frames do not skip their batches,
+    // glyphs are always drawn untextured, other batches are textured if any of their quads is
+    glyph_group.shader.variant(0);
+    for (auto *group : { &quad_group, &sprite_group }) {
+        group->shader.variant(0);
+        group->shader.variant(ShaderVariants::TEXTURED);
     }
+    std::fprintf(stdout, "[renderer] Program cache had %u hits and %u misses.\n", programs.hits, programs.misses);
+
+    // Ranges of a uniform buffer need to start at a multiple of the offset alignment
+    s32 alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    auto align = static_cast<usize>(std::max(alignment, 1));
+    batch_stride = (sizeof(BatchData) + align - 1) / align * align;
+
+    // The texture slots are bound in the shaders, the glyph atlas uses slot 0, quad textures the slots from
+    // TEXTURE_START and array textures the slots after the regular textures, such that pending programs need no setup
+
+    // Instances are expanded from a shared unit quad
+    unit_quad.layout = { ShaderType::FLOAT2 };
+    unit_quad.submit(std::vector<glm::vec2>{ { 0.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f } });
+    for (auto *group : groups()) {
+        if (mode == RenderMode::INSTANCED) {
+            group->vertex_array.submit(&unit_quad);
+        }
 
-    // Configure glyph atlas slot
-    glyph_group.shader.uniform("uniform_glyph_atlas", 0);
+        // All groups share the quad index buffer
+        group->vertex_array.submit(&index_buffer);
+    }
 }
 
 /// Begins a new render pass
 void Renderer::begin(s32 width, s32 height) {
-    glyph_group.clear();
-    quad_group.clear();
+    for (auto *group : groups()) {
+        // Grow the stream regions if the last frame did not fit into a single region
+        if (group->overflow) {
+            group->grow();
+        }
+        group->clear();
+        group->shader.swap();
+    }
+
+    frame.clear();
+    thread_count = 0;
+    retained_layers.clear();
+    batches.clear();
+    indirect_commands.clear();
+    draw_layers.clear();
+    batch.first_command = 0;
+    batch.command_count = 0;
+    layer = 0;
+    blend = BlendMode::ALPHA;
+    viewport = { static_cast<f32>(width), static_cast<f32>(height) };
+    clip.reset();
+    state_changed = true;
+    stats = {};
     transform = glm::ortho(0.0f, static_cast<f32>(width), static_cast<f32>(height), 0.0f);
+
+    auto &state = GLStateCache::current();
+    state.calls = 0;
+    state.calls_avoided = 0;
+    cache.reset_stats();
+    state.enable_depth_test(true);
+
+    auto time = std::chrono::duration<f32>(std::chrono::steady_clock::now() - start).count();
+    auto data = FrameData{ transform, viewport, time, 0.0f };
+    frame_buffer.submit(&data, sizeof(FrameData));
+    frame_buffer.bind(FRAME_DATA_BINDING);
 }
 
-/// Ends the started render pass and submits to the gpu
+/// Reloads the shaders and the font of the renderer once they change
+void Renderer::watch(AssetWatcher &watcher) {
+    // The sources are read in the background, the variants compile in the background as well and are swapped in by
+    // the first frame after they are done
+    for (auto *group : groups()) {
+        auto reload = [shader = &group->shader]() -> std::function<void()> {
+            auto vertex = File::read(shader->vertex_path);
+            auto fragment = File::read(shader->fragment_path);
+            if (not vertex or not fragment) {
+                return {};
+            }
+            return [shader, vertex = std::move(*vertex), fragment = std::move(*fragment)] {
+                shader->reload(vertex, fragment);
+            };
+        };
+        watcher.watch(group->shader.vertex_path, reload);
+        watcher.watch(group->shader.fragment_path, reload);
+    }
+
+    // The prelude is shared, hence every group compiles its variants again with the current sources
+    watcher.watch(SHADER_PRELUDE, [this]() -> std::function<void()> {
+        auto declarations = File::read(SHADER_PRELUDE);
+        if (not declarations) {
+            return {};
+        }
+        return [this, declarations = std::move(*declarations)] {
+            prelude = shader_prelude(declarations);
+            for (auto *group : groups()) {
+                group->shader.prelude = prelude;
+                group->shader.reload(group->shader.vertex_source, group->shader.fragment_source);
+            }
+        };
+    });
+
+    // Glyphs are rasterized again on their next use, retained layers with text are invalidated along with the pages
+    watcher.watch(cache.path, [this]() -> std::function<void()> {
+        auto content = File::read(cache.path, std::ios::binary);
+        if (not content) {
+            return {};
+        }
+        return [this, content = std::move(*content)] {
+            cache.reload(content);
+        };
+    });
+}
+
+/// Ends the started render pass, sorts the submission stream and submits it to the gpu in as few batches as possible
 void Renderer::end() {
-    end_internal(quad_group);
+    assert(not recording_layer and "[renderer] A retained layer is still being recorded!");
+
+    // Glyphs that were rasterized while recording are uploaded before anything samples them
+    cache.flush();
+
+    // Worker threads are done recording, their draws follow the draws of the renderer in hand out order
+    for (usize i = 0; i < thread_count; ++i) {
+        merge(thread_commands[i]);
+    }
+    stats.culled += frame.culled;
+
+    // The stream is still in submission order, which tells us what an unsorted renderer would have done
+    auto &keys = frame.keys;
+    auto unsorted_batches = transitions(keys, KEY_BATCH_MASK);
+    auto unsorted_changes = transitions(keys, KEY_STATE_MASK);
+    radix_sort(keys, sort_scratch);
+    auto sorted_batches = transitions(keys, KEY_BATCH_MASK);
+    auto sorted_changes = transitions(keys, KEY_STATE_MASK);
+    stats.quads = static_cast<u32>(keys.size());
+    stats.opaque_quads = static_cast<u32>(split_opaque(keys, sort_scratch));
+    stats.batches_merged = unsorted_batches > sorted_batches ? unsorted_batches - sorted_batches : 0;
+    stats.state_changes_avoided = unsorted_changes > sorted_changes ? unsorted_changes - sorted_changes : 0;
+
+    if (bindless and not frame.resident_handles.empty()) {
+        texture_buffer.submit(frame.resident_handles);
+    }
+    texture_slots.assign(frame.texture_handles.size(), NO_TEXTURE);
+    std::ranges::stable_sort(retained_layers, {}, &std::pair<u8, RenderLayer *>::first);
+
+    // Retained layers are drawn beneath the immediate draws of their layer, hence everything before them is drawn
+    // first, opaque draws come first anyway and are drawn front to back
+    RenderGroup *current = nullptr;
+    usize next_layer = 0;
+    auto draw_retained_until = [&](u32 bound) {
+        if (next_layer == retained_layers.size() or retained_layers[next_layer].first > bound) {
+            return;
+        }
+        if (current) {
+            flush();
+        }
+        submit();
+        for (; next_layer < retained_layers.size() and retained_layers[next_layer].first <= bound; ++next_layer) {
+            draw_retained(*retained_layers[next_layer].second, retained_layers[next_layer].first);
+        }
+    };
 
-    cache.atlas.bind(0);
-    end_internal(glyph_group);
+    auto next_batch = [&](Pipeline pipeline, BlendMode blend_mode) {
+        if (batch.command_count > 0) {
+            batches.push_back(batch);
+        }
+        batch.first_command = static_cast<u32>(indirect_commands.size());
+        batch.command_count = 0;
+        for (auto texture : batch.textures) {
+            texture_slots[texture] = NO_TEXTURE;
+        }
+        for (auto texture : batch.texture_arrays) {
+            texture_slots[texture] = NO_TEXTURE;
+        }
+        batch.textures.clear();
+        batch.texture_arrays.clear();
+        batch.permutation = 0;
+        batch.pipeline = pipeline;
+        batch.blend = blend_mode;
+    };
+
+    auto assign_slot = [&](s16 &texture_index) {
+        if (texture_index == NO_TEXTURE) {
+            return;
+        }
+        auto slot = texture_slot(batch, frame, texture_index);
+        if (slot == NO_TEXTURE) {
+            // The batch ran out of sampler slots
+            flush();
+            next_batch(batch.pipeline, batch.blend);
+            slot = texture_slot(batch, frame, texture_index);
+        }
+        texture_index = static_cast<s16>(slot);
+        batch.permutation |= ShaderVariants::TEXTURED;
+    };
+
+    for (auto key : keys) {
+        auto quad_layer = static_cast<u8>(key >> KEY_LAYER_SHIFT);
+        auto pipeline = static_cast<Pipeline>(key >> KEY_PIPELINE_SHIFT & 0xF);
+        auto blend_mode = static_cast<BlendMode>(key >> KEY_BLEND_SHIFT & 0xF);
+        if (blend_mode != BlendMode::OPAQUE) {
+            draw_retained_until(quad_layer);
+        }
+
+        if (not current or pipeline != batch.pipeline or blend_mode != batch.blend) {
+            if (current) {
+                flush();
+            }
+            next_batch(pipeline, blend_mode);
+            current = &group(pipeline);
+        } else if (quad_layer != batch.layer) {
+            // Layers only differ in their per-draw data, hence they are separate commands of the same batch
+            flush();
+        }
+        batch.layer = quad_layer;
+
+        if (pipeline == Pipeline::SPRITE) {
+            auto sprite = frame.sprites[key & KEY_ORDER_MASK];
+            assign_slot(sprite.texture_index);
+            write(*current, sprite);
+        } else {
+            auto quad = frame.quads[key & KEY_ORDER_MASK];
+            assign_slot(quad.texture_index);
+            write(*current, quad);
+        }
+    }
+    if (current) {
+        flush();
+        next_batch(batch.pipeline, batch.blend);
+    }
+    submit();
+    draw_retained_until(0xFF);
+
+    // Bindings are kept between batches and only reset once the frame is done, the depth buffer is only cleared
+    // while depth writes are enabled
+    auto &state = GLStateCache::current();
     Texture::unbind(0);
+    Shader::unbind();
+    VertexArray::unbind();
+    state.depth_mask(true);
+    state.enable_depth_test(false);
+    state.enable_blend(true);
+    stats.gl_calls = state.calls;
+    stats.gl_calls_avoided = state.calls_avoided;
+    auto shape_stats = cache.stats();
+    stats.text_run_hits = shape_stats.run_hits;
+    stats.text_run_misses = shape_stats.run_misses;
+
+    // Fence the regions of this frame, the next frame continues in the following regions
+    for (auto *group : groups()) {
+        stats.fence_stalls += group->vertex_buffer.advance();
+    }
 }
 
 /// Draws a colored quad
 void Renderer::draw_quad(const QuadExtent &ext, const glm::vec4 &color) {
-    RenderCommand command{};
-    command.vertices = {
-        Vertex{ { ext.position.x, ext.position.y }, color, { 0, 0 }, NO_TEXTURE },
-        Vertex{ { ext.position.x, ext.position.y + ext.size.y }, color, { 0, 1 }, NO_TEXTURE },
-        Vertex{ { ext.position.x + ext.size.x, ext.position.y + ext.size.y }, color, { 1, 1 }, NO_TEXTURE },
-        Vertex{ { ext.position.x + ext.size.x, ext.position.y }, color, { 1, 0 }, NO_TEXTURE },
-    };
-
-    auto offset = static_cast<u32>(quad_group.commands.size() * 4);
-    command.indices = { 0 + offset, 1 + offset, 2 + offset, 2 + offset, 0 + offset, 3 + offset };
-    quad_group.push(command);
+    recording().draw_quad(ext, color);
 }
 
 /// Draws a textured quad
 void Renderer::draw_quad(const QuadExtent &ext, const Texture &texture) {
-    s32 index;
-    if (textures.contains(texture.handle)) {
-        index = textures[texture.handle];
-    } else {
-        if (textures.size() == TEXTURE_MAX) {
-            end_internal(quad_group);
-            quad_group.clear();
-            textures.clear();
-        }
-        index = static_cast<s32>(textures.size());
-        textures[texture.handle] = index;
-    }
-    texture.bind(index + TEXTURE_START);
-
-    RenderCommand command{};
-    command.vertices = {
-        Vertex{ { ext.position.x, ext.position.y }, WHITE, { 0, 0 }, index },
-        Vertex{ { ext.position.x, ext.position.y + ext.size.y }, WHITE, { 0, 1 }, index },
-        Vertex{ { ext.position.x + ext.size.x, ext.position.y + ext.size.y }, WHITE, { 1, 1 }, index },
-        Vertex{ { ext.position.x + ext.size.x, ext.position.y }, WHITE, { 1, 0 }, index },
-    };
+    recording().draw_quad(ext, texture);
+}
 
-    auto offset = static_cast<u32>(quad_group.commands.size() * 4);
-    command.indices = { 0 + offset, 1 + offset, 2 + offset, 2 + offset, 0 + offset, 3 + offset };
-    quad_group.push(command);
+/// Draws a quad that is textured with a layer of an array texture
+void Renderer::draw_quad(const QuadExtent &ext, const TextureLayer &texture) {
+    recording().draw_quad(ext, texture);
 }
 
-/// Draws a symbol
-void Renderer::draw_symbol(const SymbolExtent &ext, const glm::vec4 &color, const GlyphInfo &glyph) {
-    auto scale = ext.size / GlyphCache::FONT_SIZE;
-    auto scaled_size = glm::vec2{ glyph.size } * scale;
-    auto scaled_position = glm::vec2{ ext.position.x + static_cast<f32>(glyph.bearing.x) * scale,
-                                      ext.position.y + static_cast<f32>(glyph.size.y - glyph.bearing.y) * scale };
+/// Draws colored quads
+void Renderer::draw_quads(std::span<const QuadExtent> exts, std::span<const glm::vec4> colors) {
+    recording().draw_quads(exts, colors);
+}
 
-    RenderCommand command{};
-    command.vertices = {
-        Vertex{ { scaled_position.x, scaled_position.y }, color, { glyph.texture_offset, 0.0f }, NO_TEXTURE },
-        Vertex{ { scaled_position.x, scaled_position.y + scaled_size.y },
-                color,
-                { glyph.texture_offset, glyph.texture_span.y },
-                NO_TEXTURE },
-        Vertex{ { scaled_position.x + scaled_size.x, scaled_position.y + scaled_size.y },
-                color,
-                { glyph.texture_offset + glyph.texture_span.x, glyph.texture_span.y },
-                NO_TEXTURE },
-        Vertex{ { scaled_position.x + scaled_size.x, scaled_position.y },
-                color,
-                { glyph.texture_offset + glyph.texture_span.x, 0.0f },
-                NO_TEXTURE }
-    };
+/// Draws quads that are textured with the same texture
+void Renderer::draw_quads(std::span<const QuadExtent> exts, const Texture &texture) {
+    recording().draw_quads(exts, texture);
+}
 
-    auto offset = static_cast<u32>(glyph_group.commands.size() * 4);
-    command.indices = { 0 + offset, 1 + offset, 2 + offset, 2 + offset, 0 + offset, 3 + offset };
-    glyph_group.push(command);
+/// Draws quads that are textured with the same layer of an array texture
+void Renderer::draw_quads(std::span<const QuadExtent> exts, const TextureLayer &texture) {
+    recording().draw_quads(exts, texture);
 }
 
-/// Draws text
-void Renderer::draw_text(const TextExtent &ext, const glm::vec4 &color, std::string_view text) {
-    auto scale = ext.size / GlyphCache::FONT_SIZE;
-    auto iterator = ext.position;
+/// Draws a colored sprite
+void Renderer::draw_sprite(const SpriteExtent &ext, const glm::vec4 &color, const glm::mat3x2 &transform) {
+    recording().draw_sprite(ext, color, transform);
+}
 
-    for (auto ch : text) {
-        switch (ch) {
-            case '\n': {
-                iterator.x = ext.position.x;
-                iterator.y += ext.size;
-                break;
-            }
-            case '\t': {
-                auto glyph = cache.acquire(' ');
-                for (u32 i = 0; i < 4; ++i) {
-                    draw_symbol({ iterator, ext.size }, color, glyph);
-                    iterator.x += glyph.advance.x * scale;
-                }
-                break;
-            }
-            default: {
-                auto glyph = cache.acquire(ch);
-                draw_symbol({ iterator, ext.size }, color, glyph);
-                iterator.x += glyph.advance.x * scale;
-            }
+/// Draws a textured sprite
+void Renderer::draw_sprite(const SpriteExtent &ext, const Texture &texture, const glm::mat3x2 &transform) {
+    recording().draw_sprite(ext, texture, transform);
+}
+
+/// Draws a sprite that is textured with a layer of an array texture
+void Renderer::draw_sprite(const SpriteExtent &ext, const TextureLayer &texture, const glm::mat3x2 &transform) {
+    recording().draw_sprite(ext, texture, transform);
+}
+
+/// Draws colored sprites
+void Renderer::draw_sprites(std::span<const SpriteExtent> exts,
+                            std::span<const glm::vec4> colors,
+                            const glm::mat3x2 &transform) {
+    recording().draw_sprites(exts, colors, transform);
+}
+
+/// Draws sprites that are textured with the same texture
+void Renderer::draw_sprites(std::span<const SpriteExtent> exts, const Texture &texture, const glm::mat3x2 &transform) {
+    recording().draw_sprites(exts, texture, transform);
+}
+
+/// Draws sprites that are textured with the same layer of an array texture
+void Renderer::draw_sprites(std::span<const SpriteExtent> exts,
+                            const TextureLayer &texture,
+                            const glm::mat3x2 &transform) {
+    recording().draw_sprites(exts, texture, transform);
+}
+
+/// Begins recording a retained layer, all subsequent draws are recorded into the layer instead of the frame
+void Renderer::begin_layer(RenderLayer &target) {
+    assert(not recording_layer and "[renderer] Retained layers cannot be nested!");
+    recording_layer = &target;
+    target.commands.clear();
+    state_changed = true;
+}
+
+/// Ends recording the retained layer and uploads its geometry once
+void Renderer::end_layer() {
+    assert(recording_layer and "[renderer] No retained layer is being recorded!");
+    auto &target = *recording_layer;
+    auto &commands = target.commands;
+    recording_layer = nullptr;
+    target.glyph_generations = cache.generations();
+
+    radix_sort(commands.keys, sort_scratch);
+    split_opaque(commands.keys, sort_scratch);
+    texture_slots.assign(commands.texture_handles.size(), NO_TEXTURE);
+    stats.culled += commands.culled;
+
+    // The layer is baked in draw order, every batch is a run of commands just like in the frame stream, quads and
+    // sprites are baked into separate buffers, hence commands address the buffer of their pipeline
+    std::vector<Instance> sorted;
+    std::vector<Sprite> sorted_sprites;
+    std::vector<DrawElementsIndirectCommand> layer_commands;
+    std::vector<u32> layer_draw_layers;
+    sorted.reserve(commands.quads.size());
+    sorted_sprites.reserve(commands.sprites.size());
+    target.batches.clear();
+
+    RenderBatch run{};
+    u32 first = 0;
+    u32 count_max = 1;
+    auto element = [&](u32 quad) {
+        return mode == RenderMode::INSTANCED ? quad : quad * 4;
+    };
+    auto written = [&](Pipeline pipeline) {
+        return static_cast<u32>(pipeline == Pipeline::SPRITE ? sorted_sprites.size() : sorted.size());
+    };
+    auto next_command = [&] {
+        auto count = written(run.pipeline) - first;
+        if (count == 0) {
+            return;
+        }
+        layer_commands.push_back(quad_command(mode, element(first), count));
+        layer_draw_layers.push_back(run.layer);
+        run.command_count++;
+        count_max = std::max(count_max, count);
+        first += count;
+    };
+    auto next_run = [&](Pipeline pipeline, BlendMode blend_mode) {
+        next_command();
+        if (run.command_count > 0) {
+            target.batches.push_back(run);
+        }
+        for (auto texture : run.textures) {
+            texture_slots[texture] = NO_TEXTURE;
+        }
+        for (auto texture : run.texture_arrays) {
+            texture_slots[texture] = NO_TEXTURE;
+        }
+        run.textures.clear();
+        run.texture_arrays.clear();
+        run.permutation = 0;
+        run.pipeline = pipeline;
+        run.blend = blend_mode;
+        run.first_command = static_cast<u32>(layer_commands.size());
+        run.command_count = 0;
+        first = written(pipeline);
+    };
+    auto assign_slot = [&](s16 &texture_index) {
+        if (texture_index == NO_TEXTURE) {
+            return;
+        }
+        auto slot = texture_slot(run, commands, texture_index);
+        if (slot == NO_TEXTURE) {
+            next_run(run.pipeline, run.blend);
+            slot = texture_slot(run, commands, texture_index);
+        }
+        texture_index = static_cast<s16>(slot);
+        run.permutation |= ShaderVariants::TEXTURED;
+    };
+
+    for (usize i = 0; i < commands.keys.size(); ++i) {
+        auto key = commands.keys[i];
+        auto quad_layer = static_cast<u8>(key >> KEY_LAYER_SHIFT);
+        auto pipeline = static_cast<Pipeline>(key >> KEY_PIPELINE_SHIFT & 0xF);
+        auto blend_mode = static_cast<BlendMode>(key >> KEY_BLEND_SHIFT & 0xF);
+        if (i == 0 or pipeline != run.pipeline or blend_mode != run.blend) {
+            next_run(pipeline, blend_mode);
+        } else if (quad_layer != run.layer) {
+            next_command();
+        } else if (mode == RenderMode::VERTEX and written(pipeline) - first == BATCH_QUADS_MAX) {
+            // A single command cannot address more quads than the shared index buffer may hold
+            next_command();
+        }
+        run.layer = quad_layer;
+
+        if (pipeline == Pipeline::SPRITE) {
+            auto sprite = commands.sprites[key & KEY_ORDER_MASK];
+            assign_slot(sprite.texture_index);
+            sorted_sprites.push_back(sprite);
+        } else {
+            auto quad = commands.quads[key & KEY_ORDER_MASK];
+            assign_slot(quad.texture_index);
+            sorted.push_back(quad);
         }
     }
+    next_run(run.pipeline, run.blend);
+
+    // Upload the baked layer, which is the only upload until the layer changes again
+    if (mode == RenderMode::INSTANCED) {
+        target.vertex_buffer.layout = Instance::layout();
+        target.vertex_buffer.submit(sorted);
+        target.vertex_array.submit(&unit_quad);
+        target.vertex_array.submit(&target.vertex_buffer, 1, 1);
+        target.sprite_buffer.layout = Sprite::layout();
+        target.sprite_buffer.submit(sorted_sprites);
+        target.sprite_array.submit(&unit_quad);
+        target.sprite_array.submit(&target.sprite_buffer, 1, 1);
+    } else {
+        std::vector<Vertex> vertices(sorted.size() * 4);
+        for (usize i = 0; i < sorted.size(); ++i) {
+            expand(sorted[i], &vertices[i * 4]);
+        }
+        target.vertex_buffer.layout = Vertex::layout();
+        target.vertex_buffer.submit(vertices);
+        target.vertex_array.submit(&target.vertex_buffer);
+
+        vertices.resize(sorted_sprites.size() * 4);
+        for (usize i = 0; i < sorted_sprites.size(); ++i) {
+            expand(sorted_sprites[i], &vertices[i * 4]);
+        }
+        target.sprite_buffer.layout = Vertex::layout();
+        target.sprite_buffer.submit(vertices);
+        target.sprite_array.submit(&target.sprite_buffer);
+    }
+    VertexArray::unbind();
+    target.indirect_buffer.submit(layer_commands);
+    target.draw_buffer.submit(layer_draw_layers);
+    if (bindless and not commands.resident_handles.empty()) {
+        target.texture_buffer.submit(commands.resident_handles);
+    }
+    reserve(mode == RenderMode::INSTANCED ? 1 : count_max);
+    target.quads = static_cast<u32>(sorted.size() + sorted_sprites.size());
+    target.dirty = false;
+}
+
+/// Sets the layer of subsequent draws
+void Renderer::set_layer(u8 value) {
+    layer = value;
+    state_changed = true;
+}
+
+/// Sets the blend mode of subsequent draws
+void Renderer::set_blend(BlendMode value) {
+    blend = value;
+    state_changed = true;
+}
+
+/// Enables or disables the opaque pass of a layer
+void Renderer::set_opaque_layer(u8 target, bool enabled) {
+    opaque_layers.set(target, enabled);
+    state_changed = true;
+}
+
+/// Sets the clip rect of subsequent draws
+void Renderer::set_clip(const std::optional<QuadExtent> &rect) {
+    clip = rect;
+    state_changed = true;
+}
+
+/// Draws a retained layer from its cached gpu buffers on the current layer
+void Renderer::draw_layer(RenderLayer &target) {
+    // Layers whose glyphs were evicted since they were recorded are skipped until their owner records them again
+    if (target.commands.glyph_pages and not cache.touch(target.commands.glyph_pages, target.glyph_generations)) {
+        target.invalidate();
+        return;
+    }
+    retained_layers.emplace_back(layer, &target);
+}
+
+/// Hands out command buffers that worker threads may record into concurrently
+std::span<CommandBuffer> Renderer::command_buffers(usize count) {
+    if (thread_commands.size() < count) {
+        thread_commands.resize(count);
+    }
+    thread_count = count;
+    for (usize i = 0; i < count; ++i) {
+        thread_commands[i].clear();
+        inherit(thread_commands[i]);
+    }
+    return { thread_commands.data(), count };
+}
+
+/// Draws a symbol
+void Renderer::draw_symbol(const SymbolExtent &ext, const glm::vec4 &color, const GlyphInfo &glyph) {
+    recording().draw_symbol(ext, color, glyph);
+}
+
+/// Draws text
+void Renderer::draw_text(const TextExtent &ext, const glm::vec4 &color, std::string_view text) {
+    recording().draw_text(ext, color, text);
 }
 
 /// Clears the currently bound frame buffer
@@ -208,45 +1507,300 @@ void Renderer::clear_color(const glm::vec4 &color) {
     glClearColor(color.r, color.g, color.b, color.a);
 }
 
-/// Ends the started render pass internally for the specified group and shader
+/// Retrieves the command buffer that draws are currently recorded into, with the current draw state
+CommandBuffer &Renderer::recording() {
+    // The state only changes between draws through the setters, or when recording switches between frame and layer
+    auto &commands = recording_layer ? recording_layer->commands : frame;
+    if (state_changed) {
+        inherit(commands);
+        state_changed = false;
+    }
+    return commands;
+}
+
+/// Copies the current draw state into the specified command buffer
+void Renderer::inherit(CommandBuffer &commands) {
+    commands.layer = layer;
+    commands.blend = blend;
+    commands.opaque_layers = opaque_layers;
+    commands.bounds = cull_bounds();
+    commands.bindless = bindless;
+    commands.cache = &cache;
+}
+
+/// Appends the draws of a command buffer to the submission stream, remapping its textures to frame-local ones
+void Renderer::merge(const CommandBuffer &commands) {
+    texture_remap.clear();
+    for (usize i = 0; i < commands.texture_handles.size(); ++i) {
+        auto resident_handle = bindless ? commands.resident_handles[i] : 0;
+        texture_remap.push_back(frame.texture_index(commands.texture_handles[i], resident_handle,
+                                                    commands.texture_layered[i]));
+    }
+
+    // Keys index their quad or sprite in recording order, hence the order bits are rebased onto the end of the stream
+    auto quad_base = frame.quads.size();
+    auto sprite_base = frame.sprites.size();
+    frame.quads.insert(frame.quads.end(), commands.quads.begin(), commands.quads.end());
+    frame.sprites.insert(frame.sprites.end(), commands.sprites.begin(), commands.sprites.end());
+    for (auto key : commands.keys) {
+        auto sprite = static_cast<Pipeline>(key >> KEY_PIPELINE_SHIFT & 0xF) == Pipeline::SPRITE;
+        auto index = (sprite ? sprite_base : quad_base) + (key & KEY_ORDER_MASK);
+        auto &texture_index = sprite ? frame.sprites[index].texture_index : frame.quads[index].texture_index;
+        key &= ~(KEY_TEXTURE_MASK | KEY_ORDER_MASK);
+        if (texture_index != NO_TEXTURE) {
+            texture_index = static_cast<s16>(texture_remap[texture_index]);
+            if (not bindless) {
+                key |= static_cast<u64>(texture_index + 1) << KEY_TEXTURE_SHIFT;
+            }
+        }
+        frame.keys.push_back(key | index);
+    }
+    stats.culled += commands.culled;
+}
+
+/// Retrieves the bounds that draws are culled against, which is the intersection of the viewport and clip rect
+glm::vec4 Renderer::cull_bounds() const {
+    constexpr auto infinity = std::numeric_limits<f32>::infinity();
+    auto bounds = recording_layer ? glm::vec4{ -infinity, -infinity, infinity, infinity }
+                                  : glm::vec4{ 0.0f, 0.0f, viewport.x, viewport.y };
+    if (clip) {
+        bounds.x = std::max(bounds.x, clip->position.x);
+        bounds.y = std::max(bounds.y, clip->position.y);
+        bounds.z = std::min(bounds.z, clip->position.x + clip->size.x);
+        bounds.w = std::min(bounds.w, clip->position.y + clip->size.y);
+    }
+    return bounds;
+}
+
+/// Retrieves the render group of a pipeline
+RenderGroup &Renderer::group(Pipeline pipeline) {
+    switch (pipeline) {
+        case Pipeline::GLYPH:
+            return glyph_group;
+        case Pipeline::SPRITE:
+            return sprite_group;
+        default:
+            return quad_group;
+    }
+}
+
+/// Retrieves all render groups, such that state that every group shares is updated for each of them
+std::array<RenderGroup *, 3> Renderer::groups() {
+    return { &glyph_group, &quad_group, &sprite_group };
+}
+
+/// Assigns a sampler slot to a recording-local texture index within a batch, array textures have their own slots, in
+/// bindless mode the recording-local index is used as is
+s32 Renderer::texture_slot(RenderBatch &target, const CommandBuffer &commands, s32 texture) {
+    if (bindless) {
+        return texture;
+    }
+
+    auto &slot = texture_slots[texture];
+    if (slot == NO_TEXTURE) {
+        auto layered = commands.texture_layered[texture];
+        auto &slots = layered ? target.texture_arrays : target.textures;
+        auto slots_max = layered ? TEXTURE_ARRAY_MAX : TEXTURE_MAX;
+        if (slots.size() == static_cast<usize>(slots_max)) {
+            return NO_TEXTURE;
+        }
+        slot = static_cast<s32>(slots.size());
+        slots.push_back(texture);
+    }
+    return slot;
+}
+
+/// Writes a quad or sprite into the stream of the specified group, flushing the batch if the stream region is
+/// exhausted
+template<typename T>
+void Renderer::write(RenderGroup &target, const T &quad) {
+    // A single batch cannot address more quads than the shared index buffer may hold
+    if (target.mode == RenderMode::VERTEX and target.count == BATCH_QUADS_MAX) {
+        flush();
+    }
+    if (target.push(quad, jobs != nullptr)) {
+        return;
+    }
+
+    // The region is full, hence draw what we have before it is fenced and continue in the next region
+    flush();
+    submit();
+    stats.fence_stalls += target.vertex_buffer.advance();
+    target.overflow = true;
+    target.clear();
+    target.push(quad, jobs != nullptr);
+}
+
+/// Records the pending quads of the current batch as an indirect draw command and continues at the current stream
+/// position
+void Renderer::flush() {
+    auto &target = group(batch.pipeline);
+    end_internal(target);
+    target.clear();
+}
+
+/// Submits the recorded batches, including the commands that the current batch has recorded so far
+void Renderer::submit() {
+    // Deferred quads are expanded before any draw reads the stream regions that they reserved
+    if (jobs) {
+        for (auto *target : groups()) {
+            target->expand_pending(*jobs);
+        }
+    }
+
+    if (batch.command_count > 0) {
+        batches.push_back(batch);
+    }
+
+    if (not batches.empty()) {
+        indirect_buffer.submit(indirect_commands);
+        indirect_buffer.bind();
+        draw_buffer.submit(draw_layers);
+        draw_buffer.bind(DRAW_DATA_BINDING);
+        if (bindless) {
+            texture_buffer.bind(TEXTURE_HANDLE_BINDING);
+        }
+
+        batch_data.clear();
+        for (auto &run : batches) {
+            push_batch_data(run, 0);
+        }
+        batch_buffer.submit(batch_data.data(), batch_data.size());
+        for (const auto &run : batches) {
+            draw_indirect(run, group(run.pipeline).vertex_array, frame.texture_handles);
+        }
+    }
+
+    // The indirect buffer is orphaned on every submission, hence the current batch continues at the first command
+    batches.clear();
+    indirect_commands.clear();
+    draw_layers.clear();
+    batch.first_command = 0;
+    batch.command_count = 0;
+}
+
+/// Grows the shared quad index buffer geometrically such that it can hold the specified number of quads
+void Renderer::reserve(u32 quads) {
+    auto capacity = index_buffer.count / 6;
+    if (quads <= capacity) {
+        return;
+    }
+
+    capacity = std::min(std::bit_ceil(quads), BATCH_QUADS_MAX);
+    index_buffer.store(quad_indices(capacity));
+
+    // Storing recreates the buffer, hence every group needs to reference the new one
+    for (auto *group : groups()) {
+        group->vertex_array.submit(&index_buffer);
+    }
+}
+
+/// Ends the started render pass internally for the specified group by recording its indirect draw command
 void Renderer::end_internal(RenderGroup &group) {
-    if (group.commands.empty()) {
+    if (group.empty()) {
         return;
     }
 
-    auto command_count = group.commands.size();
-    std::vector<Vertex> vertices(4 * command_count);
-    std::vector<u32> indices(6 * command_count);
+    reserve(group.mode == RenderMode::INSTANCED ? 1 : group.count);
+    indirect_commands.push_back(quad_command(group.mode, group.first, group.count));
+    draw_layers.push_back((batch.layer * 2u + 1u) * DEPTH_SLOT_SIZE);
+    batch.command_count++;
+    stats.draw_commands++;
+}
 
-    usize insert_index = 0;
-    for (auto &command : group.commands) {
-        auto vertex_offset = insert_index * 4;
-        vertices[vertex_offset + 0] = command.vertices[0];
-        vertices[vertex_offset + 1] = command.vertices[1];
-        vertices[vertex_offset + 2] = command.vertices[2];
-        vertices[vertex_offset + 3] = command.vertices[3];
+/// Draws the baked batches of a retained layer
+void Renderer::draw_retained(RenderLayer &target, u8 draw_layer) {
+    if (target.batches.empty()) {
+        return;
+    }
 
-        auto index_offset = insert_index * 6;
-        indices[index_offset + 0] = command.indices[0];
-        indices[index_offset + 1] = command.indices[1];
-        indices[index_offset + 2] = command.indices[2];
-        indices[index_offset + 3] = command.indices[3];
-        indices[index_offset + 4] = command.indices[4];
-        indices[index_offset + 5] = command.indices[5];
-        insert_index++;
+    // The layer shares the quad index buffer, which may have been regrown since the layer was baked
+    target.vertex_array.submit(&index_buffer);
+    target.sprite_array.submit(&index_buffer);
+    target.indirect_buffer.bind();
+    target.draw_buffer.bind(DRAW_DATA_BINDING);
+    if (bindless) {
+        target.texture_buffer.bind(TEXTURE_HANDLE_BINDING);
     }
 
-    group.vertex_buffer.submit(vertices);
-    group.index_buffer.submit(indices);
-    draw_indexed(group);
+    batch_data.clear();
+    for (auto &run : target.batches) {
+        push_batch_data(run, draw_layer * 2u * DEPTH_SLOT_SIZE);
+    }
+    batch_buffer.submit(batch_data.data(), batch_data.size());
+    for (const auto &run : target.batches) {
+        auto &vertex_array = run.pipeline == Pipeline::SPRITE ? target.sprite_array : target.vertex_array;
+        draw_indirect(run, vertex_array, target.commands.texture_handles);
+    }
+    stats.retained_quads += target.quads;
 }
 
-/// Performs the indexed draw call for the specified group
-void Renderer::draw_indexed(RenderGroup &group) const {
-    group.vertex_array.bind();
-    group.shader.bind();
-    group.shader.uniform("uniform_transform", transform);
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(group.index_buffer.count), GL_UNSIGNED_INT, nullptr);
-    Shader::unbind();
-    VertexArray::unbind();
+/// Appends the batch data of the specified batch
+void Renderer::push_batch_data(RenderBatch &run, u32 depth_base) {
+    run.data_offset = batch_data.size();
+    auto entries = draw_parameters ? 1 : run.command_count;
+    batch_data.resize(run.data_offset + entries * batch_stride);
+    for (u32 i = 0; i < entries; ++i) {
+        auto entry = BatchData{ run.first_command + i, depth_base, { 0, 0 } };
+        std::memcpy(batch_data.data() + run.data_offset + i * batch_stride, &entry, sizeof(BatchData));
+    }
+}
+
+/// Binds the state of the specified batch and draws its indirect draw commands
+void Renderer::draw_indirect(const RenderBatch &run,
+                             const VertexArray &vertex_array,
+                             const std::vector<u32> &texture_handles) {
+    // Batches without textures draw with the variant that skips the samplers, glyphs always sample their atlas,
+    // programs that are still compiling are skipped, such that the first frames show whatever is ready
+    auto permutation = run.pipeline == Pipeline::GLYPH ? 0 : run.permutation;
+    auto &shader = group(run.pipeline).shader.variant(permutation);
+    if (not shader.poll()) {
+        stats.pending_batches++;
+        return;
+    }
+
+    // Opaque draws are drawn front to back and write their depth, all other draws are drawn back to front on top
+    // of the opaque draws of their own or a lower depth
+    auto &state = GLStateCache::current();
+    if (run.blend == BlendMode::OPAQUE) {
+        state.enable_blend(false);
+        state.depth_function(GL_LESS);
+        state.depth_mask(true);
+    } else {
+        state.enable_blend(true);
+        state.blend_function(GL_SRC_ALPHA, run.blend == BlendMode::ADDITIVE ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+        state.depth_function(GL_LEQUAL);
+        state.depth_mask(false);
+    }
+
+    if (run.pipeline == Pipeline::GLYPH) {
+        cache.bind(0);
+    }
+    for (usize slot = 0; slot < run.textures.size(); ++slot) {
+        auto handle = texture_handles[run.textures[slot]];
+        state.bind_texture_unit(static_cast<u32>(slot) + TEXTURE_START, handle);
+    }
+    for (usize slot = 0; slot < run.texture_arrays.size(); ++slot) {
+        auto handle = texture_handles[run.texture_arrays[slot]];
+        state.bind_texture_unit(static_cast<u32>(slot) + TEXTURE_START + TEXTURE_MAX, handle);
+    }
+
+    vertex_array.bind();
+    shader.bind();
+
+    // The draw offset locates the per-draw data of the first command, gl_DrawID counts from there
+    auto stride = sizeof(DrawElementsIndirectCommand);
+    auto *offset = reinterpret_cast<const void *>(static_cast<usize>(run.first_command) * stride);
+    if (draw_parameters) {
+        batch_buffer.bind(BATCH_DATA_BINDING, run.data_offset, sizeof(BatchData));
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, static_cast<GLsizei>(run.command_count), 0);
+        stats.draw_calls++;
+    } else {
+        // Without gl_DrawID, every command is drawn on its own and identified through the draw offset
+        for (u32 i = 0; i < run.command_count; ++i) {
+            batch_buffer.bind(BATCH_DATA_BINDING, run.data_offset + i * batch_stride, sizeof(BatchData));
+            glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, static_cast<const u8 *>(offset) + i * stride);
+        }
+        stats.draw_calls += run.command_count;
+    }
 }
@@ -26,45 +26,135 @@
 
 #include "buffer.h"
 #include "glyph.h"
+#include "texture.h"
 #include "types.h"
 
 #include <array>
-#include <list>
+#include <bitset>
+#include <chrono>
+#include <glm/gtc/type_precision.hpp>
+#include <optional>
 #include <set>
+#include <span>
+#include <string>
+#include <vector>
 
+struct AssetWatcher;
+struct JobSystem;
+
+enum class RenderMode {
+    VERTEX = 0,
+    INSTANCED
+};
+
+/// Vertices and instances are packed, colors are stored as normalized bytes and texture coordinates as normalized
+/// shorts, which are expanded to floats by the vertex fetch
 struct Vertex {
     glm::vec2 position;
-    glm::vec4 color;
-    glm::vec2 texture_coordinates;
-    s32 texture_index;
+    glm::u8vec4 color;
+    glm::u16vec2 texture_coordinates;
+    s16 texture_index;
+    s16 texture_layer;
 
     /// Retrieves the layout of the vertex
     /// @return The layout
     static VertexBufferLayout layout();
 };
 
-struct RenderCommand {
-    std::array<Vertex, 4> vertices;
-    std::array<u32, 6> indices;
+struct Instance {
+    glm::vec2 position;
+    glm::vec2 size;
+    glm::u8vec4 color;
+    glm::u16vec4 texture_rect;
+    s16 texture_index;
+    s16 texture_layer;
+
+    /// Retrieves the layout of the instance
+    /// @return The layout
+    static VertexBufferLayout layout();
+};
+
+/// Transformed quads are stored as parallelograms, whose corners are the origin plus any combination of both axes
+struct Sprite {
+    glm::vec2 origin;
+    glm::vec2 axis_x;
+    glm::vec2 axis_y;
+    glm::u8vec4 color;
+    glm::u16vec4 texture_rect;
+    s16 texture_index;
+    s16 texture_layer;
+
+    /// Retrieves the layout of the sprite
+    /// @return The layout
+    static VertexBufferLayout layout();
 };
 
 struct RenderGroup {
-    std::list<RenderCommand> commands;
     VertexArray vertex_array;
-    VertexBuffer vertex_buffer;
-    IndexBuffer index_buffer;
-    Shader shader;
+    StreamBuffer vertex_buffer;
+    ShaderVariants shader;
+    RenderMode mode;
+    usize stride;
+    u32 first;
+    u32 count;
+    bool overflow;
+
+    /// In vertex mode, quads may reserve their vertices in the stream and be expanded later on, such that the
+    /// expansion of a whole submission is split across the job system
+    std::vector<std::pair<Vertex *, Instance>> pending_quads;
+    std::vector<std::pair<Vertex *, Sprite>> pending_sprites;
+
+    static inline constexpr usize REGION_QUADS = 16384;
+    static inline constexpr u32 EXPAND_GRAIN = 1024;
 
     /// Creates a new render group
     /// @param vertex The vertex shader path
     /// @param fragment The fragment shader path
-    RenderGroup(const fs::path &vertex, const fs::path &fragment);
+    /// @param mode The render mode, which decides whether the group streams vertices or instances
+    /// @param programs The program cache that the shader variants are loaded from, or nullptr to compile them
+    /// @param prelude The declarations that the shaders of all render groups share
+    /// @param instance_stride The size of a single instance
+    /// @param instance_layout The layout of a single instance
+    RenderGroup(const fs::path &vertex,
+                const fs::path &fragment,
+                RenderMode mode,
+                ProgramCache *programs = nullptr,
+                std::string prelude = {},
+                usize instance_stride = sizeof(Instance),
+                const VertexBufferLayout &instance_layout = Instance::layout());
 
-    /// Clears the specified render group (i.e. deletes the commands)
+    /// Clears the specified render group, the next batch starts at the current position of the vertex stream
     void clear();
 
-    /// Pushes a render command to the render group
-    void push(const RenderCommand &command);
+    /// Doubles the size of the stream regions
+    void grow();
+
+    /// Writes a quad into the mapped stream of the render group, in vertex mode it is expanded into its four corner
+    /// vertices right within the stream
+    /// @param instance The instance attributes of the quad
+    /// @param defer Whether the vertices are only reserved and expanded by the next call to expand_pending
+    /// @return A boolean value that indicates whether the current stream region could hold the quad
+    bool push(const Instance &instance, bool defer = false);
+
+    /// Writes a sprite into the mapped stream of the render group, in vertex mode it is expanded into its four corner
+    /// vertices right within the stream
+    /// @param sprite The instance attributes of the sprite
+    /// @param defer Whether the vertices are only reserved and expanded by the next call to expand_pending
+    /// @return A boolean value that indicates whether the current stream region could hold the sprite
+    bool push(const Sprite &sprite, bool defer = false);
+
+    /// Expands the deferred quads and sprites into the vertices that they reserved, every job expands a disjoint range
+    /// of them, this has to happen before the region that they were written to is drawn
+    /// @param jobs The job system
+    void expand_pending(JobSystem &jobs);
+
+    /// Checks whether the render group contains any quads
+    /// @return A boolean value that indicates whether the group is empty
+    bool empty() const;
+
+private:
+    /// Submits the stream buffer to the vertex array, instance attributes start after the unit quad corner
+    void submit();
 };
 
 struct QuadExtent {
@@ -79,25 +169,359 @@ struct SymbolExtent {
 
 using TextExtent = SymbolExtent;
 
+/// A quad that is rotated around its pivot, which is given relative to the size of the quad, and placed such that
+/// its pivot lies at the position, positive rotations are clockwise as the y axis points down
+struct SpriteExtent {
+    glm::vec2 position;
+    glm::vec2 size;
+    f32 rotation;
+    glm::vec2 pivot;
+};
+
+enum class Pipeline : u32 {
+    QUAD = 0,
+    GLYPH,
+    SPRITE
+};
+
+/// Opaque draws are not blended but drawn front to back before all other draws of their layer, such that the depth
+/// test discards the fragments they hide, on layers whose opaque pass is enabled untextured quads and sprites without
+/// any transparency are drawn opaque automatically
+enum class BlendMode : u32 {
+    ALPHA = 0,
+    ADDITIVE,
+    OPAQUE
+};
+
+struct RenderBatch {
+    Pipeline pipeline;
+    BlendMode blend;
+    std::vector<s32> textures;
+    std::vector<s32> texture_arrays;
+
+    /// The bitmask of the shader defines that the batch needs, such that batches draw with the cheapest variant
+    u32 permutation;
+
+    /// The layer of the pending quads and the range of indirect draw commands that share the state of the batch
+    u8 layer;
+    u32 first_command;
+    u32 command_count;
+
+    /// The offset of the batch's data in the batch buffer of its submission
+    usize data_offset;
+};
+
+/// The data of a frame that all shaders share, which is laid out as std140
+struct FrameData {
+    glm::mat4 view_projection;
+    glm::vec2 viewport;
+    f32 time;
+    f32 padding;
+};
+
+/// The data of a batch, or of a single command if commands cannot be identified through gl_DrawID, which is laid out
+/// as std140
+struct BatchData {
+    u32 draw_offset;
+    u32 depth_base;
+    u32 padding[2];
+};
+
+struct RenderStats {
+    u32 draw_calls;
+    u32 draw_commands;
+    u32 fence_stalls;
+    u32 quads;
+    u32 opaque_quads;
+    u32 retained_quads;
+    u32 culled;
+    u32 batches_merged;
+    u32 state_changes_avoided;
+    u32 gl_calls;
+    u32 gl_calls_avoided;
+    u32 pending_batches;
+    u32 text_run_hits;
+    u32 text_run_misses;
+};
+
+/// Command buffers record draws without touching any gl state, hence every thread may fill its own command buffer
+/// without locking, they are aligned to a cache line such that neighbouring buffers do not share one
+struct alignas(64) CommandBuffer {
+    constexpr static inline glm::mat3x2 IDENTITY{ 1.0f };
+
+    /// The state of subsequent draws, which is inherited from the renderer when the command buffer is handed out
+    u8 layer;
+    BlendMode blend;
+    std::bitset<256> opaque_layers;
+    glm::vec4 bounds;
+    bool bindless;
+    GlyphCache *cache;
+    u32 culled;
+
+    /// The bitmask of the glyph atlas pages that the recorded glyphs sample
+    u32 glyph_pages;
+
+    /// The recorded draws, every draw is a sort key whose least significant bits index the recorded quad or, for the
+    /// sprite pipeline, the recorded sprite
+    std::vector<u64> keys;
+    std::vector<Instance> quads;
+    std::vector<Sprite> sprites;
+
+    /// The textures that the recorded draws reference through their recording-local texture index
+    std::unordered_map<u32, s32> textures;
+    std::vector<u32> texture_handles;
+    std::vector<bool> texture_layered;
+    std::vector<u64> resident_handles;
+
+    /// Scratch space for a line whose tabs are expanded and for its shaped glyphs
+    std::string expanded;
+    std::vector<ShapedGlyph> shaped_glyphs;
+    std::vector<GlyphInfo> glyph_infos;
+
+    /// Creates an empty command buffer
+    CommandBuffer();
+
+    /// Records a colored quad
+    /// @param ext The quad's extent
+    void draw_quad(const QuadExtent &ext, const glm::vec4 &color);
+
+    /// Records a textured quad
+    /// @param ext The quad's extent
+    void draw_quad(const QuadExtent &ext, const Texture &texture);
+
+    /// Records a quad that is textured with a layer of an array texture
+    /// @param ext The quad's extent
+    /// @param texture The array texture and the layer within it
+    void draw_quad(const QuadExtent &ext, const TextureLayer &texture);
+
+    /// Records colored quads in a single pass
+    /// @param exts The quads' extents
+    /// @param colors The quads' colors, a single color is shared by all quads
+    void draw_quads(std::span<const QuadExtent> exts, std::span<const glm::vec4> colors);
+
+    /// Records quads that are textured with the same texture in a single pass
+    /// @param exts The quads' extents
+    void draw_quads(std::span<const QuadExtent> exts, const Texture &texture);
+
+    /// Records quads that are textured with the same layer of an array texture in a single pass
+    /// @param exts The quads' extents
+    /// @param texture The array texture and the layer within it
+    void draw_quads(std::span<const QuadExtent> exts, const TextureLayer &texture);
+
+    /// Records a colored sprite
+    /// @param ext The sprite's extent
+    /// @param transform The affine transform that is applied after the sprite is rotated and placed
+    void draw_sprite(const SpriteExtent &ext, const glm::vec4 &color, const glm::mat3x2 &transform = IDENTITY);
+
+    /// Records a textured sprite
+    /// @param ext The sprite's extent
+    /// @param transform The affine transform that is applied after the sprite is rotated and placed
+    void draw_sprite(const SpriteExtent &ext, const Texture &texture, const glm::mat3x2 &transform = IDENTITY);
+
+    /// Records a sprite that is textured with a layer of an array texture
+    /// @param ext The sprite's extent
+    /// @param texture The array texture and the layer within it
+    /// @param transform The affine transform that is applied after the sprite is rotated and placed
+    void draw_sprite(const SpriteExtent &ext, const TextureLayer &texture, const glm::mat3x2 &transform = IDENTITY);
+
+    /// Records colored sprites in a single pass, their corners are transformed several sprites at a time
+    /// @param exts The sprites' extents
+    /// @param colors The sprites' colors, a single color is shared by all sprites
+    /// @param transform The affine transform that is applied after the sprites are rotated and placed
+    void draw_sprites(std::span<const SpriteExtent> exts,
+                      std::span<const glm::vec4> colors,
+                      const glm::mat3x2 &transform = IDENTITY);
+
+    /// Records sprites that are textured with the same texture in a single pass
+    /// @param exts The sprites' extents
+    /// @param transform The affine transform that is applied after the sprites are rotated and placed
+    void draw_sprites(std::span<const SpriteExtent> exts,
+                      const Texture &texture,
+                      const glm::mat3x2 &transform = IDENTITY);
+
+    /// Records sprites that are textured with the same layer of an array texture in a single pass
+    /// @param exts The sprites' extents
+    /// @param texture The array texture and the layer within it
+    /// @param transform The affine transform that is applied after the sprites are rotated and placed
+    void draw_sprites(std::span<const SpriteExtent> exts,
+                      const TextureLayer &texture,
+                      const glm::mat3x2 &transform = IDENTITY);
+
+    /// Records a symbol
+    /// @param ext The symbol's extent
+    void draw_symbol(const SymbolExtent &ext, const glm::vec4 &color, const GlyphInfo &glyph);
+
+    /// Records text
+    /// @param ext The text's extent
+    void draw_text(const TextExtent &ext, const glm::vec4 &color, std::string_view text);
+
+    /// Retrieves the recording-local index of a texture, textures that are used for the first time are assigned the
+    /// next free index
+    /// @param handle The texture handle
+    /// @param resident_handle The bindless handle of the texture
+    /// @param layered Whether the texture is an array texture
+    /// @return The recording-local texture index
+    s32 texture_index(u32 handle, u64 resident_handle, bool layered);
+
+    /// Clears all recorded draws and textures
+    void clear();
+
+private:
+    /// Records a quad unless it lies entirely outside of the bounds
+    /// @param pipeline The pipeline that draws the quad
+    /// @param ext The quad's extent
+    /// @param color The quad's color
+    /// @param texture_rect The texture coordinate offset (xy) and span (zw)
+    /// @param texture The recording-local texture index or NO_TEXTURE
+    /// @param texture_layer The layer of an array texture or NO_TEXTURE for regular textures
+    void record(Pipeline pipeline,
+                const QuadExtent &ext,
+                const glm::vec4 &color,
+                const glm::vec4 &texture_rect,
+                s32 texture,
+                s32 texture_layer);
+
+    /// Records quads that share their pipeline and texture, the quads that lie entirely outside of the bounds are
+    /// compacted away while they are recorded
+    /// @param pipeline The pipeline that draws the quads
+    /// @param exts The quads' extents
+    /// @param colors The quads' colors, a single color is shared by all quads
+    /// @param texture_rect The texture coordinate offset (xy) and span (zw)
+    /// @param texture The recording-local texture index or NO_TEXTURE
+    /// @param texture_layer The layer of an array texture or NO_TEXTURE for regular textures
+    void record(Pipeline pipeline,
+                std::span<const QuadExtent> exts,
+                std::span<const glm::vec4> colors,
+                const glm::vec4 &texture_rect,
+                s32 texture,
+                s32 texture_layer);
+
+    /// Transforms and records sprites that share their texture, the sprites whose bounding box lies entirely outside
+    /// of the bounds are culled
+    /// @param exts The sprites' extents
+    /// @param colors The sprites' colors, a single color is shared by all sprites
+    /// @param transform The affine transform that is applied after the sprites are rotated and placed
+    /// @param texture The recording-local texture index or NO_TEXTURE
+    /// @param texture_layer The layer of an array texture or NO_TEXTURE for regular textures
+    void record(std::span<const SpriteExtent> exts,
+                std::span<const glm::vec4> colors,
+                const glm::mat3x2 &transform,
+                s32 texture,
+                s32 texture_layer);
+};
+
+struct RenderLayer {
+    CommandBuffer commands;
+    VertexArray vertex_array;
+    VertexBuffer vertex_buffer;
+    VertexArray sprite_array;
+    VertexBuffer sprite_buffer;
+    IndirectBuffer indirect_buffer;
+    StorageBuffer draw_buffer;
+    StorageBuffer texture_buffer;
+    std::vector<RenderBatch> batches;
+    u32 quads;
+    bool dirty;
+
+    /// The generations of the glyph atlas pages when the layer was recorded, the layer is invalidated once a page
+    /// that its glyphs sample was evicted
+    std::array<u32, GlyphCache::PAGE_COUNT> glyph_generations;
+
+    /// Creates a new retained layer, which is dirty until it is recorded for the first time
+    RenderLayer();
+
+    /// Marks the layer as changed, such that its owner records it again
+    void invalidate();
+};
+
 struct Renderer {
     GlyphCache cache;
+    RenderMode mode;
+    bool bindless;
+    IndexBuffer index_buffer;
+    VertexBuffer unit_quad;
+    ProgramCache programs;
+
+    /// The declarations that all shaders share along with the constants that they have to agree on with the renderer,
+    /// which is the frame data, the batch data and the depth of a draw
+    std::string prelude;
     RenderGroup glyph_group;
     RenderGroup quad_group;
+    RenderGroup sprite_group;
     glm::mat4 transform;
+    RenderStats stats;
+
+    /// The frame data is uploaded once per frame and bound to a fixed binding point, while the batch data of all
+    /// batches of a submission is uploaded at once and every batch binds its own range
+    constexpr static inline u32 FRAME_DATA_BINDING = 0;
+    constexpr static inline u32 BATCH_DATA_BINDING = 1;
+    std::chrono::steady_clock::time_point start;
+    UniformBuffer frame_buffer;
+    UniformBuffer batch_buffer;
+    std::vector<u8> batch_data;
+    usize batch_stride;
 
+    /// The viewport of the current render pass, draws that lie entirely outside of it are culled before they are
+    /// recorded, retained layers are only culled by the clip rect
+    glm::vec2 viewport;
+
+    /// The submission stream of the current render pass, the command buffers of worker threads are merged into it in
+    /// the order in which they were handed out
+    CommandBuffer frame;
+    std::vector<CommandBuffer> thread_commands;
+    usize thread_count;
+
+    /// The job system that the vertex expansion of a submission is split across, or nullptr to expand every quad as
+    /// it is written
+    JobSystem *jobs;
+    std::vector<s32> texture_remap;
+    std::vector<u64> sort_scratch;
+
+    constexpr static inline u32 BATCH_QUADS_MAX = 1 << 16;
     constexpr static inline s32 TEXTURE_START = 1;
-    constexpr static inline s32 TEXTURE_MAX = 32;
-    std::unordered_map<u32, s32> textures;
+    constexpr static inline s32 TEXTURE_MAX = 24;
+    constexpr static inline s32 TEXTURE_ARRAY_MAX = 8;
+    std::vector<s32> texture_slots;
+    RenderBatch batch;
+
+    /// With GL_ARB_bindless_texture, textures are not bound to slots, instead their resident handles are stored in
+    /// a storage buffer that is indexed by the frame-local texture index
+    constexpr static inline u32 TEXTURE_HANDLE_BINDING = 0;
+    StorageBuffer texture_buffer;
+
+    /// Batches are recorded as runs of indirect draw commands, every run is submitted with a single multi draw call
+    /// and its draws look up their per-draw data through gl_DrawID, which is the depth of the draw, every layer has a
+    /// slot for its retained draws that are further divided by their recorded layer and one for its immediate draws
+    constexpr static inline u32 DRAW_DATA_BINDING = 1;
+    constexpr static inline u32 DEPTH_SLOT_SIZE = 256;
+    bool draw_parameters;
+    std::vector<RenderBatch> batches;
+    std::vector<DrawElementsIndirectCommand> indirect_commands;
+    std::vector<u32> draw_layers;
+    IndirectBuffer indirect_buffer;
+    StorageBuffer draw_buffer;
+
+    /// Retained layers are recorded into their own command buffer and baked into their own gpu buffers, the layers
+    /// drawn in this frame are drawn beneath the immediate draws of the same layer
+    RenderLayer *recording_layer;
+    std::vector<std::pair<u8, RenderLayer *>> retained_layers;
 
     /// Creates a new renderer
-    Renderer();
+    /// @param mode The render mode, instanced rendering streams one instance instead of four vertices per quad
+    explicit Renderer(RenderMode mode = RenderMode::VERTEX);
 
-    /// Begins a new render pass
+    /// Begins a new render pass, which swaps in the shaders that finished reloading
     /// @param width The width of the viewport
     /// @param height The height of the viewport
     void begin(s32 width, s32 height);
 
-    /// Ends the started render pass and submits to the gpu
+    /// Reloads the shaders and the font of the renderer once they change, shaders that fail to compile keep their
+    /// programs, retained layers that hold text are invalidated once the font changed
+    /// @param watcher The asset watcher, which the renderer has to outlive
+    void watch(AssetWatcher &watcher);
+
+    /// Ends the started render pass, sorts the submission stream and submits it to the gpu in as few batches as
+    /// possible
     void end();
 
     /// Draws a colored quad
@@ -108,6 +532,110 @@ struct Renderer {
     /// @param ext The quad's extent
     void draw_quad(const QuadExtent &ext, const Texture &texture);
 
+    /// Draws a quad that is textured with a layer of an array texture
+    /// @param ext The quad's extent
+    /// @param texture The array texture and the layer within it
+    void draw_quad(const QuadExtent &ext, const TextureLayer &texture);
+
+    /// Draws colored quads, which is considerably cheaper than drawing them one by one
+    /// @param exts The quads' extents
+    /// @param colors The quads' colors, a single color is shared by all quads
+    void draw_quads(std::span<const QuadExtent> exts, std::span<const glm::vec4> colors);
+
+    /// Draws quads that are textured with the same texture
+    /// @param exts The quads' extents
+    void draw_quads(std::span<const QuadExtent> exts, const Texture &texture);
+
+    /// Draws quads that are textured with the same layer of an array texture
+    /// @param exts The quads' extents
+    /// @param texture The array texture and the layer within it
+    void draw_quads(std::span<const QuadExtent> exts, const TextureLayer &texture);
+
+    /// Draws a colored sprite, which is a quad that is rotated around its pivot
+    /// @param ext The sprite's extent
+    /// @param transform The affine transform that is applied after the sprite is rotated and placed
+    void draw_sprite(const SpriteExtent &ext,
+                     const glm::vec4 &color,
+                     const glm::mat3x2 &transform = CommandBuffer::IDENTITY);
+
+    /// Draws a textured sprite
+    /// @param ext The sprite's extent
+    /// @param transform The affine transform that is applied after the sprite is rotated and placed
+    void draw_sprite(const SpriteExtent &ext,
+                     const Texture &texture,
+                     const glm::mat3x2 &transform = CommandBuffer::IDENTITY);
+
+    /// Draws a sprite that is textured with a layer of an array texture
+    /// @param ext The sprite's extent
+    /// @param texture The array texture and the layer within it
+    /// @param transform The affine transform that is applied after the sprite is rotated and placed
+    void draw_sprite(const SpriteExtent &ext,
+                     const TextureLayer &texture,
+                     const glm::mat3x2 &transform = CommandBuffer::IDENTITY);
+
+    /// Draws colored sprites, whose corners are transformed several sprites at a time
+    /// @param exts The sprites' extents
+    /// @param colors The sprites' colors, a single color is shared by all sprites
+    /// @param transform The affine transform that is applied after the sprites are rotated and placed
+    void draw_sprites(std::span<const SpriteExtent> exts,
+                      std::span<const glm::vec4> colors,
+                      const glm::mat3x2 &transform = CommandBuffer::IDENTITY);
+
+    /// Draws sprites that are textured with the same texture
+    /// @param exts The sprites' extents
+    /// @param transform The affine transform that is applied after the sprites are rotated and placed
+    void draw_sprites(std::span<const SpriteExtent> exts,
+                      const Texture &texture,
+                      const glm::mat3x2 &transform = CommandBuffer::IDENTITY);
+
+    /// Draws sprites that are textured with the same layer of an array texture
+    /// @param exts The sprites' extents
+    /// @param texture The array texture and the layer within it
+    /// @param transform The affine transform that is applied after the sprites are rotated and placed
+    void draw_sprites(std::span<const SpriteExtent> exts,
+                      const TextureLayer &texture,
+                      const glm::mat3x2 &transform = CommandBuffer::IDENTITY);
+
+    /// Begins recording a retained layer, all subsequent draws are recorded into the layer instead of the frame
+    /// @param target The layer, its previous recording is discarded
+    void begin_layer(RenderLayer &target);
+
+    /// Ends recording the retained layer and uploads its geometry once, the textures that the layer references must
+    /// outlive the recording
+    void end_layer();
+
+    /// Sets the layer of subsequent draws, draws on a higher layer are always drawn on top of draws on a lower layer,
+    /// while draws on the same layer are ordered by state and then by submission, where opaque draws are beneath all
+    /// other draws of their layer, the layer is reset to 0 by every render pass
+    /// @param value The layer
+    void set_layer(u8 value);
+
+    /// Sets the blend mode of subsequent draws, which is reset to alpha blending by every render pass
+    /// @param value The blend mode
+    void set_blend(BlendMode value);
+
+    /// Enables or disables the opaque pass of a layer, which persists across frames, on these layers untextured draws
+    /// without any transparency are drawn opaque and hence beneath all other draws of the layer, even those that were
+    /// submitted before them, such that layers whose draws rely on their submission order must not enable it
+    /// @param target The layer
+    /// @param enabled Whether the opaque pass of the layer is enabled
+    void set_opaque_layer(u8 target, bool enabled = true);
+
+    /// Sets the clip rect of subsequent draws, draws that lie entirely outside of it are culled before they are
+    /// recorded, the clip rect is reset by every render pass
+    /// @param rect The clip rect, or std::nullopt to only cull against the viewport
+    void set_clip(const std::optional<QuadExtent> &rect);
+
+    /// Draws a retained layer from its cached gpu buffers on the current layer
+    /// @param target The recorded layer, which must outlive the render pass
+    void draw_layer(RenderLayer &target);
+
+    /// Hands out command buffers that worker threads may record into concurrently, each buffer must only be used by a
+    /// single thread until the render pass ends, their draws are drawn after the draws of the renderer itself
+    /// @param count The number of command buffers
+    /// @return The cleared command buffers, which inherit the current layer, blend mode and clip rect
+    std::span<CommandBuffer> command_buffers(usize count);
+
     /// Draws a symbol
     /// @param ext The symbol's extent
     void draw_symbol(const SymbolExtent &ext, const glm::vec4 &color, const GlyphInfo &glyph);
@@ -124,11 +652,77 @@ struct Renderer {
     static void clear_color(const glm::vec4 &color);
 
 private:
-    /// Ends the started render pass internally for the specified group
+    /// The draw state of subsequent draws, which is only copied into the command buffer that draws are recorded into
+    /// once it changed, hence it is changed through the setters
+    u8 layer;
+    BlendMode blend;
+    std::bitset<256> opaque_layers;
+    std::optional<QuadExtent> clip;
+    bool state_changed;
+
+    /// Retrieves the command buffer that draws are currently recorded into, with the current draw state
+    CommandBuffer &recording();
+
+    /// Copies the current draw state into the specified command buffer
+    void inherit(CommandBuffer &commands);
+
+    /// Appends the draws of a command buffer to the submission stream, remapping its textures to frame-local ones
+    void merge(const CommandBuffer &commands);
+
+    /// Retrieves the bounds that draws are culled against, which is the intersection of the viewport and clip rect
+    /// @return The minimum (xy) and maximum (zw) of the bounds
+    glm::vec4 cull_bounds() const;
+
+    /// Retrieves the render group of a pipeline
+    RenderGroup &group(Pipeline pipeline);
+
+    /// Retrieves all render groups, such that state that every group shares is updated for each of them
+    std::array<RenderGroup *, 3> groups();
+
+    /// Assigns a sampler slot to a recording-local texture index within a batch, array textures have their own
+    /// slots, in bindless mode the recording-local index is used as is
+    /// @param target The batch
+    /// @param commands The command buffer that recorded the texture
+    /// @param texture The recording-local texture index
+    /// @return The slot or NO_TEXTURE if the batch has no slots left
+    s32 texture_slot(RenderBatch &target, const CommandBuffer &commands, s32 texture);
+
+    /// Writes a quad or sprite into the stream of the specified group, flushing the batch if the stream region is
+    /// exhausted
+    template<typename T>
+    void write(RenderGroup &group, const T &quad);
+
+    /// Records the pending quads of the current batch as an indirect draw command and continues at the current stream
+    /// position
+    void flush();
+
+    /// Submits the recorded batches, including the commands that the current batch has recorded so far
+    void submit();
+
+    /// Grows the shared quad index buffer geometrically such that it can hold the specified number of quads
+    void reserve(u32 quads);
+
+    /// Ends the started render pass internally for the specified group by recording its indirect draw command
     void end_internal(RenderGroup &group);
 
-    /// Performs the indexed draw call for the specified group
-    void draw_indexed(RenderGroup &group) const;
+    /// Draws the baked batches of a retained layer
+    /// @param target The layer
+    /// @param draw_layer The layer that the retained layer is drawn on, which offsets its recorded layers
+    void draw_retained(RenderLayer &target, u8 draw_layer);
+
+    /// Appends the batch data of the specified batch, which holds an entry for every command if commands cannot be
+    /// identified through gl_DrawID
+    /// @param run The batch
+    /// @param depth_base The depth that is added to the depths of the batch's commands
+    void push_batch_data(RenderBatch &run, u32 depth_base);
+
+    /// Binds the state of the specified batch and draws its indirect draw commands
+    /// @param run The batch
+    /// @param vertex_array The vertex array that holds the quads of the batch
+    /// @param texture_handles The texture handles that the batch's slots refer to
+    void draw_indirect(const RenderBatch &run,
+                       const VertexArray &vertex_array,
+                       const std::vector<u32> &texture_handles);
 };
 
 #endif// ENGINE_RENDERER_H
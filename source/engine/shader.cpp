@@ -23,179 +23,652 @@
 
 #include "shader.h"
 #include "file.h"
+#include "state.h"
 
+#include <algorithm>
+#include <array>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <string>
+#include <vector>
 
 namespace {
 
-/// Compiles the shader source
-std::optional<u32> compile(const fs::path &path, u32 type) {
-    auto source = File::read(path);
-    if (not source) {
-        return std::nullopt;
+/// Hashes the specified data with 64-bit FNV-1a, continuing from the specified hash
+u64 fnv1a(std::string_view data, u64 hash = 14695981039346656037ull) {
+    for (auto c : data) {
+        hash = (hash ^ static_cast<u8>(c)) * 1099511628211ull;
     }
+    return hash;
+}
 
-    auto program = glCreateShader(type);
-    auto *shader_source = static_cast<const GLchar *>(source->data());
-    glShaderSource(program, 1, &shader_source, nullptr);
-    glCompileShader(program);
+/// Starts compiling the shader source, which may finish in the background with GL_KHR_parallel_shader_compile
+u32 create_stage(std::string_view source, u32 type) {
+    auto stage = glCreateShader(type);
+    auto *shader_source = static_cast<const GLchar *>(source.data());
+    auto length = static_cast<GLint>(source.size());
+    glShaderSource(stage, 1, &shader_source, &length);
+    glCompileShader(stage);
+    return stage;
+}
 
+/// Checks whether the stage compiled and prints its log if it did not
+bool check_stage(u32 stage) {
     s32 success;
-    glGetShaderiv(program, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(stage, GL_COMPILE_STATUS, &success);
     if (not success) {
         s32 info_length;
-        glGetShaderiv(program, GL_INFO_LOG_LENGTH, &info_length);
+        glGetShaderiv(stage, GL_INFO_LOG_LENGTH, &info_length);
 
         std::string message(info_length, 0);
-        glGetShaderInfoLog(program, info_length, &info_length, message.data());
-        glDeleteProgram(program);
+        glGetShaderInfoLog(stage, info_length, &info_length, message.data());
         std::fprintf(stderr, "[shader] Compilation failed: %s\n", message.data());
-        return std::nullopt;
     }
-    return program;
+    return success;
 }
 
+/// Starts linking the program of the specified stages, which may finish in the background as well, the stages stay
+/// attached until the program is checked
+u32 link(u32 vertex_stage, u32 fragment_stage, bool retrievable) {
+    auto handle = glCreateProgram();
+    if (retrievable) {
+        glProgramParameteri(handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glAttachShader(handle, vertex_stage);
+    glAttachShader(handle, fragment_stage);
+    glLinkProgram(handle);
+    return handle;
+}
+
+/// Reads the source of a shader stage
+std::string read_source(const fs::path &path) {
+    auto source = File::read(path);
+    if (not source) {
+        assert(false and "[shader] Failed to read shader sources!");
+        return {};
+    }
+    return std::move(*source);
+}
+
+/// Injects the defines of the specified permutation and the prelude after the #version directive and the #extension
+/// directives that follow it, which must come before everything else in GLSL
+std::string inject(std::string_view source, u32 permutation, std::string_view prelude, bool vertex) {
+    // Without a #version directive the defines go first
+    auto version = source.find("#version");
+    usize insert = 0;
+    if (version != std::string_view::npos) {
+        insert = source.find('\n', version);
+        insert = insert == std::string_view::npos ? source.size() : insert + 1;
+        while (source.substr(insert).starts_with("#extension")) {
+            insert = source.find('\n', insert);
+            insert = insert == std::string_view::npos ? source.size() : insert + 1;
+        }
+    }
+
+    std::string result{ source.substr(0, insert) };
+    if (not result.empty() and result.back() != '\n') {
+        result += '\n';
+    }
+    for (usize bit = 0; bit < ShaderVariants::DEFINES.size(); ++bit) {
+        if (permutation & (1u << bit)) {
+            result += "#define ";
+            result += ShaderVariants::DEFINES[bit];
+            result += '\n';
+        }
+    }
+
+    // The prelude is numbered as a source string of its own, such that compile errors within it can be told apart
+    if (not prelude.empty()) {
+        if (vertex) {
+            result += "#define VERTEX_SHADER\n";
+        }
+        result += "#line 1 1\n";
+        result += prelude;
+        if (result.back() != '\n') {
+            result += '\n';
+        }
+    }
+
+    // Compile errors keep reporting the lines of the original source, which continues at the line after the
+    // directives, that is line 2 unless comments precede them or the source enables extensions
+    if ((permutation != 0 or not prelude.empty()) and version != std::string_view::npos) {
+        auto line = std::count(source.begin(), source.begin() + static_cast<std::ptrdiff_t>(insert), '\n') + 1;
+        result += "#line " + std::to_string(line) + " 0\n";
+    }
+    result += source.substr(insert);
+    return result;
+}
 
 }// namespace
 
-/// Creates a shader from the given vertex and fragment shader files
-Shader::Shader(const fs::path &vertex, const fs::path &fragment) {
-    auto vertex_program = compile(vertex, GL_VERTEX_SHADER);
-    auto fragment_program = compile(fragment, GL_FRAGMENT_SHADER);
+/// Starts a worker thread with a hidden context that shares its objects with the current context
+ShaderWorker::ShaderWorker() : context(nullptr), thread(), mutex(), condition(), tasks(), running(true) {
+    // The version hints of the main window are still set, only the window itself must not show up
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context = glfwCreateWindow(1, 1, "", nullptr, glfwGetCurrentContext());
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (not context) {
+        assert(false and "[shader] Failed to create shader worker context!");
+    }
+    thread = std::thread([this] { run(); });
+}
+
+/// Finishes the submitted tasks, stops the worker thread and destroys its context
+ShaderWorker::~ShaderWorker() {
+    {
+        std::lock_guard lock{ mutex };
+        running = false;
+    }
+    condition.notify_one();
+    thread.join();
+    glfwDestroyWindow(context);
+}
 
-    if (not vertex_program) {
-        assert(false and "[shader] Failed to compile vertex shader!");
+/// Submits a task that is run on the worker thread with the worker context current
+void ShaderWorker::submit(std::function<void()> task) {
+    {
+        std::lock_guard lock{ mutex };
+        tasks.push_back(std::move(task));
     }
-    if (not fragment_program) {
-        assert(false and "[shader] Failed to compile fragment shader!");
+    condition.notify_one();
+}
+
+/// Runs the submitted tasks until the worker is stopped
+void ShaderWorker::run() {
+    glfwMakeContextCurrent(context);
+    while (true) {
+        std::unique_lock lock{ mutex };
+        condition.wait(lock, [this] { return not running or not tasks.empty(); });
+        if (tasks.empty()) {
+            break;
+        }
+        auto task = std::move(tasks.front());
+        tasks.pop_front();
+        lock.unlock();
+        task();
     }
+    glfwMakeContextCurrent(nullptr);
+}
 
+/// Creates a program cache that stores its binaries in the specified directory
+ProgramCache::ProgramCache(const fs::path &directory)
+    : directory(directory),
+      driver(),
+      binaries(false),
+      mutex(),
+      stages(),
+      hits(0),
+      misses(0),
+      worker() {
+    // Binaries are only valid for the driver that created them
+    for (auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+        if (const auto *value = glGetString(name)) {
+            driver += reinterpret_cast<const char *>(value);
+        }
+        driver += '\n';
+    }
+
+    s32 formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    binaries = formats > 0;
+
+    // Let the driver pick the number of compiler threads, without the extension a worker compiles in the background
+    if (GLAD_GL_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    } else {
+        worker = std::make_unique<ShaderWorker>();
+    }
+}
+
+/// Stops the worker and deletes the shared stages
+ProgramCache::~ProgramCache() {
+    worker.reset();
+    for (auto [key, stage] : stages) {
+        glDeleteShader(stage.handle);
+    }
+}
+
+/// Computes the key of a program
+u64 ProgramCache::key(std::string_view vertex, std::string_view fragment) const {
+    // The lengths separate the sources, such that moving text from one source to the other changes the key
+    auto hash = fnv1a(driver);
+    for (auto source : { vertex, fragment }) {
+        auto length = source.size();
+        hash = fnv1a({ reinterpret_cast<const char *>(&length), sizeof(length) }, hash);
+        hash = fnv1a(source, hash);
+    }
+    return hash;
+}
+
+/// Loads the binary of a program
+std::optional<u32> ProgramCache::load(u64 key) {
+    auto content = binaries ? File::read(path(key), std::ios::binary) : std::nullopt;
+    if (not content or content->size() <= sizeof(u32)) {
+        misses++;
+        return std::nullopt;
+    }
+
+    u32 format;
+    std::memcpy(&format, content->data(), sizeof(u32));
     auto handle = glCreateProgram();
-    glAttachShader(handle, *vertex_program);
-    glAttachShader(handle, *fragment_program);
-    glLinkProgram(handle);
+    auto size = static_cast<GLsizei>(content->size() - sizeof(u32));
+    glProgramBinary(handle, format, content->data() + sizeof(u32), size);
 
+    // Drivers reject binaries of other driver versions, in which case the program is compiled again
     s32 link_success;
     glGetProgramiv(handle, GL_LINK_STATUS, &link_success);
     if (not link_success) {
-        s32 info_length;
-        glGetProgramiv(handle, GL_INFO_LOG_LENGTH, &info_length);
-
-        std::string message(info_length, 0);
-        glGetProgramInfoLog(handle, info_length, &info_length, message.data());
         glDeleteProgram(handle);
-        glDeleteProgram(*vertex_program);
-        glDeleteProgram(*fragment_program);
+        std::fprintf(stdout, "[shader] Program binary '%s' was rejected.\n", path(key).string().c_str());
+        misses++;
+        return std::nullopt;
+    }
+    hits++;
+    return handle;
+}
 
-        std::fprintf(stderr, "[shader] Linking failed: %s\n", message.data());
-        assert(false and "[shader] Failed to link programs!");
+/// Stores the binary of a linked program
+void ProgramCache::store(u64 key, u32 program) const {
+    if (not binaries) {
+        return;
     }
-    this->handle = handle;
 
-    s32 uniform_count;
-    glGetProgramiv(handle, GL_ACTIVE_UNIFORMS, &uniform_count);
+    s32 length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
 
-    s32 uniform_length;
-    glGetProgramiv(handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniform_length);
+    u32 format;
+    std::vector<char> binary(static_cast<usize>(length));
+    glGetProgramBinary(program, length, &length, &format, binary.data());
 
-    if (uniform_count > 0 and uniform_length > 0) {
-        std::string uniform_name(uniform_length, 0);
-        for (s32 i = 0; i < uniform_count; ++i) {
-            s32 length;
-            s32 size;
-            u32 type;
+    std::error_code error;
+    fs::create_directories(directory, error);
+    std::ofstream file(path(key), std::ios::binary | std::ios::trunc);
+    if (error or not file.good()) {
+        std::fprintf(stderr, "[shader] Cannot write program binary '%s'!\n", path(key).string().c_str());
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(&format), sizeof(u32));
+    file.write(binary.data(), length);
+}
 
-            glGetActiveUniform(handle, i, uniform_length, &length, &size, &type, uniform_name.data());
-            auto location = glGetUniformLocation(handle, uniform_name.data());
-            uniforms[uniform_name] = location;
+/// Computes the key of a stage
+u64 ProgramCache::stage_key(std::string_view source, u32 type) {
+    return fnv1a({ reinterpret_cast<const char *>(&type), sizeof(type) }, fnv1a(source));
+}
 
-            std::fprintf(stdout, "[shader] Uniform '%s' has location '%d'.\n", uniform_name.data(), location);
+/// Acquires the stage of the specified source
+u32 ProgramCache::stage(std::string_view source, u32 type) {
+    // The worker acquires stages while the main thread releases them
+    std::lock_guard lock{ mutex };
+    auto &stage = stages[stage_key(source, type)];
+    if (stage.users++ == 0) {
+        stage.handle = create_stage(source, type);
+    }
+    return stage.handle;
+}
+
+/// Releases a stage that was acquired by a program
+void ProgramCache::release(u64 key) {
+    std::lock_guard lock{ mutex };
+    auto it = stages.find(key);
+    if (it == stages.end()) {
+        return;
+    }
+
+    // Stages that are still attached to a program are only deleted once they are detached
+    if (--it->second.users == 0) {
+        glDeleteShader(it->second.handle);
+        stages.erase(it);
+    }
+}
+
+/// Retrieves the path of the binary with the specified key
+fs::path ProgramCache::path(u64 key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return directory / name;
+}
+
+/// Creates a shader from the given vertex and fragment shader files
+Shader::Shader(const fs::path &vertex, const fs::path &fragment, ProgramCache *programs)
+    : Shader(std::string_view{ read_source(vertex) }, std::string_view{ read_source(fragment) }, programs) {
+}
+
+/// Creates a shader from the given vertex and fragment shader sources
+Shader::Shader(std::string_view vertex_source, std::string_view fragment_source, ProgramCache *programs)
+    : handle(0),
+      uniforms(),
+      status(ShaderStatus::PENDING),
+      programs(programs),
+      key(0),
+      stages(),
+      linked() {
+    // Without a program cache, the program is compiled right away
+    if (not programs) {
+        auto vertex_stage = create_stage(vertex_source, GL_VERTEX_SHADER);
+        auto fragment_stage = create_stage(fragment_source, GL_FRAGMENT_SHADER);
+        handle = link(vertex_stage, fragment_stage, false);
+        glDeleteShader(vertex_stage);
+        glDeleteShader(fragment_stage);
+        finish(false);
+        return;
+    }
+
+    key = programs->key(vertex_source, fragment_source);
+    if (auto cached = programs->load(key)) {
+        handle = *cached;
+        finish(false);
+        return;
+    }
+
+    // The program is compiled in the background, either by the driver or by the worker, and polled until it is done,
+    // the stages are shared with programs that are compiled meanwhile and released once the program is linked
+    stages = { ProgramCache::stage_key(vertex_source, GL_VERTEX_SHADER),
+               ProgramCache::stage_key(fragment_source, GL_FRAGMENT_SHADER) };
+    if (not programs->worker) {
+        auto vertex_stage = programs->stage(vertex_source, GL_VERTEX_SHADER);
+        auto fragment_stage = programs->stage(fragment_source, GL_FRAGMENT_SHADER);
+        handle = link(vertex_stage, fragment_stage, true);
+        return;
+    }
+
+    linked = std::make_shared<std::atomic<u32>>(0);
+    programs->worker->submit([programs, linked = linked, vertex_source = std::string{ vertex_source },
+                              fragment_source = std::string{ fragment_source }] {
+        auto vertex_stage = programs->stage(vertex_source, GL_VERTEX_SHADER);
+        auto fragment_stage = programs->stage(fragment_source, GL_FRAGMENT_SHADER);
+        auto program = link(vertex_stage, fragment_stage, true);
+
+        // The program is only complete for other contexts once the worker context finished it
+        s32 link_success;
+        glGetProgramiv(program, GL_LINK_STATUS, &link_success);
+        glFinish();
+        linked->store(program, std::memory_order_release);
+    });
+}
+
+/// Creates the variants of the given vertex and fragment shader files, no variant is compiled yet
+ShaderVariants::ShaderVariants(const fs::path &vertex,
+                               const fs::path &fragment,
+                               ProgramCache *programs,
+                               std::string prelude)
+    : vertex_path(vertex),
+      fragment_path(fragment),
+      vertex_source(read_source(vertex)),
+      fragment_source(read_source(fragment)),
+      prelude(std::move(prelude)),
+      programs(programs),
+      variants(),
+      reloads(),
+      queued(false) {
+}
+
+/// Retrieves the variant of the specified permutation, which starts compiling on first use
+Shader &ShaderVariants::variant(u32 permutation) {
+    auto &shader = variants[permutation];
+    if (not shader) {
+        std::fprintf(stdout, "[shader] Compiling variant 0x%x.\n", permutation);
+        shader = compile(permutation);
+    }
+    return *shader;
+}
+
+/// Starts compiling the compiled variants again from the specified sources
+void ShaderVariants::reload(std::string vertex, std::string fragment) {
+    vertex_source = std::move(vertex);
+    fragment_source = std::move(fragment);
+
+    // Replacing a pending reload would wait for its program, the newest sources are compiled once it is swapped in
+    if (not reloads.empty()) {
+        queued = true;
+        return;
+    }
+    recompile();
+}
+
+/// Replaces the variants whose reload finished compiling, variants whose reload failed keep their program
+void ShaderVariants::swap() {
+    for (auto it = reloads.begin(); it != reloads.end();) {
+        auto &[permutation, shader] = *it;
+        if (shader->poll()) {
+            std::fprintf(stdout, "[shader] Reloaded variant 0x%x.\n", permutation);
+            variants[permutation] = std::move(shader);
+        } else if (shader->status == ShaderStatus::FAILED) {
+            std::fprintf(stderr, "[shader] Reloading variant 0x%x failed, keeping its program.\n", permutation);
+        } else {
+            ++it;
+            continue;
         }
+        it = reloads.erase(it);
+    }
+
+    if (queued and reloads.empty()) {
+        queued = false;
+        recompile();
+    }
+}
+
+/// Starts compiling the compiled variants from the current sources
+void ShaderVariants::recompile() {
+    for (const auto &[permutation, shader] : variants) {
+        reloads[permutation] = compile(permutation);
     }
 }
 
+/// Starts compiling the specified permutation from the current sources
+std::unique_ptr<Shader> ShaderVariants::compile(u32 permutation) {
+    return std::make_unique<Shader>(std::string_view{ inject(vertex_source, permutation, prelude, true) },
+                                    std::string_view{ inject(fragment_source, permutation, prelude, false) },
+                                    programs);
+}
+
 /// Destroys the specified shader
 Shader::~Shader() {
+    // The worker must be done with the program before it is deleted, whether it linked or not
+    if (linked) {
+        while (not linked->load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        handle = linked->load(std::memory_order_relaxed);
+    }
+    release_stages();
+    GLStateCache::current().release_program(handle);
     glDeleteProgram(handle);
 }
 
+/// Checks whether the program finished compiling
+bool Shader::poll() {
+    if (status != ShaderStatus::PENDING) {
+        return status == ShaderStatus::READY;
+    }
+
+    if (linked) {
+        auto program = linked->load(std::memory_order_acquire);
+        if (not program) {
+            return false;
+        }
+        handle = program;
+        linked.reset();
+    } else {
+        s32 completed;
+        glGetProgramiv(handle, GL_COMPLETION_STATUS_KHR, &completed);
+        if (not completed) {
+            return false;
+        }
+    }
+    finish(true);
+    return status == ShaderStatus::READY;
+}
+
+/// Waits until the program finished compiling
+void Shader::wait() {
+    while (status == ShaderStatus::PENDING) {
+        if (linked) {
+            std::this_thread::yield();
+        } else {
+            // Querying the link status blocks until the driver is done
+            s32 link_success;
+            glGetProgramiv(handle, GL_LINK_STATUS, &link_success);
+        }
+        poll();
+    }
+
+    // Failed programs only report their errors, callers that wait on a program expect it to work
+    if (status == ShaderStatus::FAILED) {
+        assert(false and "[shader] Failed to link programs!");
+    }
+}
+
 /// Sets a s32 uniform
-void Shader::uniform(const char *name, s32 value) {
-    bind();
-    glUniform1i(uniform_location(name), value);
+void Shader::uniform(UniformId id, s32 value) {
+    glProgramUniform1i(handle, uniform_location(id), value);
 }
 
 /// Sets a u32 uniform
-void Shader::uniform(const char *name, u32 value) {
-    bind();
-    glUniform1ui(uniform_location(name), value);
+void Shader::uniform(UniformId id, u32 value) {
+    glProgramUniform1ui(handle, uniform_location(id), value);
 }
 
 /// Sets a glm::ivec2 uniform
-void Shader::uniform(const char *name, const glm::ivec2 &value) {
-    bind();
-    glUniform2i(uniform_location(name), value.x, value.y);
+void Shader::uniform(UniformId id, const glm::ivec2 &value) {
+    glProgramUniform2i(handle, uniform_location(id), value.x, value.y);
 }
 
 /// Sets a glm::ivec3 uniform
-void Shader::uniform(const char *name, const glm::ivec3 &value) {
-    bind();
-    glUniform3i(uniform_location(name), value.x, value.y, value.z);
+void Shader::uniform(UniformId id, const glm::ivec3 &value) {
+    glProgramUniform3i(handle, uniform_location(id), value.x, value.y, value.z);
 }
 
 /// Sets a glm::ivec4 uniform
-void Shader::uniform(const char *name, const glm::ivec4 &value) {
-    bind();
-    glUniform4i(uniform_location(name), value.x, value.y, value.z, value.w);
+void Shader::uniform(UniformId id, const glm::ivec4 &value) {
+    glProgramUniform4i(handle, uniform_location(id), value.x, value.y, value.z, value.w);
 }
 
 /// Sets a f32 uniform
-void Shader::uniform(const char *name, f32 value) {
-    bind();
-    glUniform1f(uniform_location(name), value);
+void Shader::uniform(UniformId id, f32 value) {
+    glProgramUniform1f(handle, uniform_location(id), value);
 }
 
 /// Sets a glm::vec2 uniform
-void Shader::uniform(const char *name, const glm::vec2 &value) {
-    bind();
-    glUniform2f(uniform_location(name), value.x, value.y);
+void Shader::uniform(UniformId id, const glm::vec2 &value) {
+    glProgramUniform2f(handle, uniform_location(id), value.x, value.y);
 }
 
 /// Sets a glm::vec3 uniform
-void Shader::uniform(const char *name, const glm::vec3 &value) {
-    bind();
-    glUniform3f(uniform_location(name), value.x, value.y, value.z);
+void Shader::uniform(UniformId id, const glm::vec3 &value) {
+    glProgramUniform3f(handle, uniform_location(id), value.x, value.y, value.z);
 }
 
 /// Sets a glm::vec4 uniform
-void Shader::uniform(const char *name, const glm::vec4 &value) {
-    bind();
-    glUniform4f(uniform_location(name), value.x, value.y, value.z, value.w);
+void Shader::uniform(UniformId id, const glm::vec4 &value) {
+    glProgramUniform4f(handle, uniform_location(id), value.x, value.y, value.z, value.w);
 }
 
 /// Sets a glm::mat4 uniform
-void Shader::uniform(const char *name, const glm::mat4 &value) {
-    bind();
-    glUniformMatrix4fv(uniform_location(name), 1, GL_FALSE, &value[0][0]);
+void Shader::uniform(UniformId id, const glm::mat4 &value) {
+    glProgramUniformMatrix4fv(handle, uniform_location(id), 1, GL_FALSE, &value[0][0]);
+}
+
+/// Sets a s32 array uniform
+void Shader::uniform(UniformId id, std::span<const s32> values) {
+    glProgramUniform1iv(handle, uniform_location(id), static_cast<GLsizei>(values.size()), values.data());
 }
 
 /// Binds the shader
 void Shader::bind() const {
-    glUseProgram(handle);
+    GLStateCache::current().use_program(handle);
 }
 
 /// Unbinds the currently bound shader
 void Shader::unbind() {
-    glUseProgram(0);
+    GLStateCache::current().use_program(0);
 }
 
 /// Retrieves the location of a uniform
-s32 Shader::uniform_location(const char *name) {
-    if (uniforms.contains(name)) {
-        return uniforms[name];
+s32 Shader::uniform_location(UniformId id) {
+    // Waiting here would hide a stall behind every uniform update, hence callers wait for the program once
+    assert(status == ShaderStatus::READY and "[shader] Uniforms may only be set once the program is ready!");
+    auto it = uniforms.find(id.hash);
+    return it != uniforms.end() ? it->second : -1;
+}
+
+/// Checks the linked program, stores its binary and retrieves its uniforms
+void Shader::finish(bool store) {
+    s32 attached = 0;
+    std::array<u32, 2> attached_stages{};
+    glGetAttachedShaders(handle, static_cast<GLsizei>(attached_stages.size()), &attached, attached_stages.data());
+
+    s32 link_success;
+    glGetProgramiv(handle, GL_LINK_STATUS, &link_success);
+    if (not link_success) {
+        for (auto stage : std::span{ attached_stages.data(), static_cast<usize>(attached) }) {
+            check_stage(stage);
+        }
+
+        s32 info_length;
+        glGetProgramiv(handle, GL_INFO_LOG_LENGTH, &info_length);
+
+        std::string message(info_length, 0);
+        glGetProgramInfoLog(handle, info_length, &info_length, message.data());
+        std::fprintf(stderr, "[shader] Linking failed: %s\n", message.data());
+        status = ShaderStatus::FAILED;
+        release_stages();
+        return;
+    }
+
+    // Detached stages that no other program uses anymore are deleted, others were already flagged for deletion
+    for (auto stage : std::span{ attached_stages.data(), static_cast<usize>(attached) }) {
+        glDetachShader(handle, stage);
+    }
+    release_stages();
+    if (store and programs) {
+        programs->store(key, handle);
+    }
+
+    s32 uniform_count;
+    glGetProgramiv(handle, GL_ACTIVE_UNIFORMS, &uniform_count);
+
+    s32 uniform_length;
+    glGetProgramiv(handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniform_length);
+
+    if (uniform_count > 0 and uniform_length > 0) {
+        std::string uniform_name(uniform_length, 0);
+        for (s32 i = 0; i < uniform_count; ++i) {
+            s32 length;
+            s32 size;
+            u32 type;
+
+            // Members of uniform blocks have no location, arrays are reported by the name of their first element
+            glGetActiveUniform(handle, i, uniform_length, &length, &size, &type, uniform_name.data());
+            auto location = glGetUniformLocation(handle, uniform_name.data());
+            if (location == -1) {
+                continue;
+            }
+            auto name = std::string_view{ uniform_name.data(), static_cast<usize>(length) };
+            if (name.ends_with("[0]")) {
+                name.remove_suffix(3);
+            }
+
+            auto [it, inserted] = uniforms.emplace(UniformId::from(name).hash, location);
+            if (not inserted) {
+                assert(false and "[shader] Uniform names collide!");
+            }
+            std::fprintf(stdout, "[shader] Uniform '%s' has location '%d'.\n", uniform_name.data(), location);
+        }
+    }
+    status = ShaderStatus::READY;
+}
+
+/// Releases the stages that the program acquired from the program cache
+void Shader::release_stages() {
+    for (auto &stage : stages) {
+        if (stage) {
+            programs->release(stage);
+            stage = 0;
+        }
     }
-    auto location = glGetUniformLocation(handle, name);
-    uniforms[name] = location;
-    return location;
 }
@@ -26,6 +26,20 @@
 
 #include "types.h"
 
+#include <GLFW/glfw3.h>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+
 enum class ShaderType {
     INT = 0,
     INT2,
@@ -35,78 +49,243 @@ enum class ShaderType {
     FLOAT2,
     FLOAT3,
     FLOAT4,
+
+    /// Packed vertex attribute types, normalized types are read as floats in [0, 1], half floats as floats and the
+    /// remaining types as integers
+    UBYTE4_NORM,
+    USHORT2_NORM,
+    USHORT4_NORM,
+    HALF2,
+    HALF4,
+    SHORT2,
+    USHORT,
+    USHORT2,
     SAMPLER = INT
 };
 
+/// Identifies a uniform through the FNV-1a hash of its name, which is computed at compile time for string literals,
+/// such that setting a uniform neither hashes nor allocates strings, array uniforms are identified by their base name
+struct UniformId {
+    u32 hash;
+
+    /// Hashes the name of a uniform at compile time
+    /// @param name The name of the uniform
+    consteval UniformId(const char *name) : hash(fnv1a(name)) {
+    }
+
+    /// Hashes the name of a uniform at run time
+    /// @param name The name of the uniform
+    /// @return The uniform id
+    static constexpr UniformId from(std::string_view name) {
+        return UniformId{ fnv1a(name) };
+    }
+
+private:
+    constexpr explicit UniformId(u32 hash) : hash(hash) {
+    }
+
+    /// Hashes the specified name with 32-bit FNV-1a
+    static constexpr u32 fnv1a(std::string_view name) {
+        u32 hash = 2166136261u;
+        for (auto c : name) {
+            hash = (hash ^ static_cast<u8>(c)) * 16777619u;
+        }
+        return hash;
+    }
+};
+
+/// Compiles programs on a thread with its own context when the driver lacks GL_KHR_parallel_shader_compile, the
+/// context shares its objects with the context that was current when the worker was created
+struct ShaderWorker {
+    GLFWwindow *context;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::function<void()>> tasks;
+    bool running;
+
+    /// Starts a worker thread with a hidden context that shares its objects with the current context
+    ShaderWorker();
+
+    /// Finishes the submitted tasks, stops the worker thread and destroys its context
+    ~ShaderWorker();
+
+    /// Submits a task that is run on the worker thread with the worker context current
+    /// @param task The task
+    void submit(std::function<void()> task);
+
+private:
+    /// Runs the submitted tasks until the worker is stopped
+    void run();
+};
+
+/// A compiled stage that pending programs share, it is deleted once the last of them finished linking
+struct ProgramStage {
+    u32 handle;
+    u32 users;
+};
+
+/// Caches linked programs as driver binaries on disk and compiled stages in memory, such that programs that were
+/// linked by an earlier run are not compiled again and stages that several programs share are compiled once
+struct ProgramCache {
+    fs::path directory;
+    std::string driver;
+    bool binaries;
+    std::mutex mutex;
+    std::unordered_map<u64, ProgramStage> stages;
+    u32 hits;
+    u32 misses;
+    std::unique_ptr<ShaderWorker> worker;
+
+    /// Creates a program cache that stores its binaries in the specified directory, which starts a worker if the
+    /// driver cannot compile programs in the background by itself
+    /// @param directory The cache directory, which is created when the first binary is stored
+    explicit ProgramCache(const fs::path &directory = "cache/shaders");
+
+    /// Stops the worker and deletes the shared stages
+    ~ProgramCache();
+
+    /// Computes the key of a program, which covers its sources and the driver, as binaries are driver specific
+    /// @param vertex The vertex shader source
+    /// @param fragment The fragment shader source
+    /// @return The key
+    u64 key(std::string_view vertex, std::string_view fragment) const;
+
+    /// Loads the binary of a program, which counts as a hit or a miss
+    /// @param key The key of the program
+    /// @return The linked program, or std::nullopt if there is no binary or the driver rejected it
+    std::optional<u32> load(u64 key);
+
+    /// Stores the binary of a linked program
+    /// @param key The key of the program
+    /// @param program The linked program
+    void store(u64 key, u32 program) const;
+
+    /// Computes the key of a stage
+    /// @param source The stage source
+    /// @param type The stage type
+    /// @return The key
+    static u64 stage_key(std::string_view source, u32 type);
+
+    /// Acquires the stage of the specified source, which starts compiling on first use and is checked when the first
+    /// program that uses it is linked
+    /// @param source The stage source
+    /// @param type The stage type
+    /// @return The stage
+    u32 stage(std::string_view source, u32 type);
+
+    /// Releases a stage that was acquired by a program, which deletes the stage once no program uses it anymore
+    /// @param key The key of the stage
+    void release(u64 key);
+
+private:
+    /// Retrieves the path of the binary with the specified key
+    /// @param key The key of the program
+    /// @return The path
+    fs::path path(u64 key) const;
+};
+
+/// The compile state of a program, pending programs are skipped by the renderer until they are ready
+enum class ShaderStatus {
+    PENDING = 0,
+    READY,
+    FAILED
+};
+
 struct Shader {
     u32 handle;
-    std::unordered_map<std::string, s32> uniforms;
+    std::unordered_map<u32, s32> uniforms;
+    ShaderStatus status;
+    ProgramCache *programs;
+    u64 key;
+    std::array<u64, 2> stages;
+    std::shared_ptr<std::atomic<u32>> linked;
 
-    /// Creates a shader from the given vertex and fragment shader files
+    /// Creates a shader from the given vertex and fragment shader files, programs that fail to compile report their
+    /// errors and are never ready
     /// @param vertex path to the vertex shader
     /// @param fragment path to the fragment shader
-    Shader(const fs::path &vertex, const fs::path &fragment);
+    /// @param programs The program cache that the program is loaded from or stored into, or nullptr to compile it
+    /// right away, with a program cache the program compiles in the background unless its binary is cached
+    Shader(const fs::path &vertex, const fs::path &fragment, ProgramCache *programs = nullptr);
+
+    /// Creates a shader from the given vertex and fragment shader sources
+    /// @param vertex_source The vertex shader source
+    /// @param fragment_source The fragment shader source
+    /// @param programs The program cache that the program is loaded from or stored into, or nullptr to compile it
+    /// right away
+    Shader(std::string_view vertex_source, std::string_view fragment_source, ProgramCache *programs = nullptr);
 
     /// Destroys the specified shader
     ~Shader();
 
+    /// Checks whether the program finished compiling, which neither blocks nor stalls the driver
+    /// @return Whether the program is ready
+    bool poll();
+
+    /// Checks whether the program is ready, without querying the driver
+    /// @return Whether the program is ready
+    bool ready() const {
+        return status == ShaderStatus::READY;
+    }
+
+    /// Waits until the program finished compiling, which has to happen before any of its uniforms are set
+    void wait();
+
     /// Sets a s32 uniform
-    /// @param name uniform name
+    /// @param id uniform id
     /// @param value value
-    void uniform(const char *name, s32 value);
+    void uniform(UniformId id, s32 value);
 
     /// Sets a u32 uniform
-    /// @param name uniform name
+    /// @param id uniform id
     /// @param value value
-    void uniform(const char *name, u32 value);
+    void uniform(UniformId id, u32 value);
 
     /// Sets a glm::ivec2 uniform
-    /// @param self shader handle
-    /// @param name uniform name
+    /// @param id uniform id
     /// @param value value
-    void uniform(const char *name, const glm::ivec2 &value);
+    void uniform(UniformId id, const glm::ivec2 &value);
 
     /// Sets a glm::ivec3 uniform
-    /// @param self shader handle
-    /// @param name uniform name
+    /// @param id uniform id
     /// @param value value
-    void uniform(const char *name, const glm::ivec3 &value);
+    void uniform(UniformId id, const glm::ivec3 &value);
 
     /// Sets a glm::ivec4 uniform
-    /// @param self shader handle
-    /// @param name uniform name
+    /// @param id uniform id
     /// @param value value
-    void uniform(const char *name, const glm::ivec4 &value);
+    void uniform(UniformId id, const glm::ivec4 &value);
 
     /// Sets a f32 uniform
-    /// @param self shader handle
-    /// @param name uniform name
+    /// @param id uniform id
     /// @param value value
-    void uniform(const char *name, f32 value);
+    void uniform(UniformId id, f32 value);
 
     /// Sets a glm::vec2 uniform
-    /// @param self shader handle
-    /// @param name uniform name
+    /// @param id uniform id
     /// @param value value
-    void uniform(const char *name, const glm::vec2 &value);
+    void uniform(UniformId id, const glm::vec2 &value);
 
     /// Sets a glm::vec3 uniform
-    /// @param self shader handle
-    /// @param name uniform name
+    /// @param id uniform id
     /// @param value value
-    void uniform(const char *name, const glm::vec3 &value);
+    void uniform(UniformId id, const glm::vec3 &value);
 
     /// Sets a glm::vec4 uniform
-    /// @param self shader handle
-    /// @param name uniform name
+    /// @param id uniform id
     /// @param value value
-    void uniform(const char *name, const glm::vec4 &value);
+    void uniform(UniformId id, const glm::vec4 &value);
 
     /// Sets a glm::mat4 uniform
-    /// @param self shader handle
-    /// @param name uniform name
+    /// @param id uniform id
     /// @param value value
-    void uniform(const char *name, const glm::mat4 &value);
+    void uniform(UniformId id, const glm::mat4 &value);
+
+    /// Sets a s32 array uniform
+    /// @param id uniform id
+    /// @param values values
+    void uniform(UniformId id, std::span<const s32> values);
 
     /// Binds the shader
     void bind() const;
@@ -115,10 +294,76 @@ struct Shader {
     static void unbind();
 
 private:
-    /// Retrieves the location of a uniform
-    /// @param name The name of the uniform
-    /// @return The location
-    s32 uniform_location(const char *name);
+    /// Retrieves the location of a uniform, the program has to be ready
+    /// @param id The id of the uniform
+    /// @return The location, or -1 if the uniform is not active, which setting a uniform ignores
+    s32 uniform_location(UniformId id);
+
+    /// Checks the linked program, stores its binary and retrieves its uniforms
+    /// @param store Whether the binary of the program is stored in the program cache
+    void finish(bool store);
+
+    /// Releases the stages that the program acquired from the program cache
+    void release_stages();
+};
+
+/// The permutations of a shader, every permutation is a combination of defines that is injected after #version and
+/// identified by a bitmask of the defines, variants are compiled on first use and cached by their bitmask, the
+/// program cache tells them apart by their sources
+struct ShaderVariants {
+    /// Samples the textures of the batch, untextured batches skip the sampler arrays entirely
+    constexpr static inline u32 TEXTURED = 1u << 0;
+
+    /// The names of the defines, indexed by their bit
+    constexpr static inline std::array<std::string_view, 1> DEFINES{ "TEXTURED" };
+
+    fs::path vertex_path;
+    fs::path fragment_path;
+    std::string vertex_source;
+    std::string fragment_source;
+
+    /// Declarations that both stages share, which are injected after the defines, the vertex stage additionally
+    /// defines VERTEX_SHADER such that the prelude can hold declarations that only the vertex stage may use
+    std::string prelude;
+    ProgramCache *programs;
+    std::unordered_map<u32, std::unique_ptr<Shader>> variants;
+    std::unordered_map<u32, std::unique_ptr<Shader>> reloads;
+    bool queued;
+
+    /// Creates the variants of the given vertex and fragment shader files, no variant is compiled yet
+    /// @param vertex path to the vertex shader
+    /// @param fragment path to the fragment shader
+    /// @param programs The program cache that the variants are loaded from or stored into, or nullptr to compile them
+    /// right away
+    /// @param prelude The declarations that both stages share
+    ShaderVariants(const fs::path &vertex,
+                   const fs::path &fragment,
+                   ProgramCache *programs = nullptr,
+                   std::string prelude = {});
+
+    /// Retrieves the variant of the specified permutation, which starts compiling on first use
+    /// @param permutation The bitmask of the defines
+    /// @return The variant
+    Shader &variant(u32 permutation);
+
+    /// Starts compiling the compiled variants again from the specified sources, the variants keep their programs
+    /// until the reloaded programs are swapped in, while a reload is still compiling the sources are queued instead
+    /// @param vertex The vertex shader source
+    /// @param fragment The fragment shader source
+    void reload(std::string vertex, std::string fragment);
+
+    /// Replaces the variants whose reload finished compiling, variants whose reload failed keep their program, and
+    /// starts the queued reload once the pending one is done
+    void swap();
+
+private:
+    /// Starts compiling the compiled variants from the current sources
+    void recompile();
+
+    /// Starts compiling the specified permutation from the current sources
+    /// @param permutation The bitmask of the defines
+    /// @return The shader
+    std::unique_ptr<Shader> compile(u32 permutation);
 };
 
 #endif// ENGINE_SHADER_H
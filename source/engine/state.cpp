@@ -0,0 +1,269 @@
+//
+// MIT License
+//
+// Copyright (c) 2024 Elias Engelbert Plank
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "state.h"
+
+#include <algorithm>
+
+/// Creates a cache that knows none of the state
+GLStateCache::GLStateCache()
+    : program(UNKNOWN),
+      vertex_array(UNKNOWN),
+      framebuffer(UNKNOWN),
+      array_buffer(UNKNOWN),
+      indirect_buffer(UNKNOWN),
+      storage_buffers(),
+      uniform_buffers(),
+      textures(),
+      blend(UNKNOWN),
+      blend_source(UNKNOWN),
+      blend_destination(UNKNOWN),
+      depth_test(UNKNOWN),
+      depth_func(UNKNOWN),
+      depth_write(UNKNOWN),
+      view(-1),
+      calls(0),
+      calls_avoided(0) {
+    invalidate();
+}
+
+/// Retrieves the cache of the context that is current on the calling thread
+GLStateCache &GLStateCache::current() {
+    // A context is current on at most one thread, and every thread that uses a context keeps it current
+    thread_local GLStateCache cache{};
+    return cache;
+}
+
+/// Forgets all state, such that the next change of every state is issued
+void GLStateCache::invalidate() {
+    program = UNKNOWN;
+    vertex_array = UNKNOWN;
+    framebuffer = UNKNOWN;
+    array_buffer = UNKNOWN;
+    indirect_buffer = UNKNOWN;
+    storage_buffers.fill(BufferBinding{ UNKNOWN, 0, 0 });
+    uniform_buffers.fill(BufferBinding{ UNKNOWN, 0, 0 });
+    textures.fill(UNKNOWN);
+    blend = UNKNOWN;
+    blend_source = UNKNOWN;
+    blend_destination = UNKNOWN;
+    depth_test = UNKNOWN;
+    depth_func = UNKNOWN;
+    depth_write = UNKNOWN;
+    view = glm::ivec4{ -1 };
+}
+
+/// Binds the specified program
+void GLStateCache::use_program(u32 handle) {
+    if (update(program, handle)) {
+        glUseProgram(handle);
+    }
+}
+
+/// Binds the specified vertex array
+void GLStateCache::bind_vertex_array(u32 handle) {
+    if (update(vertex_array, handle)) {
+        glBindVertexArray(handle);
+    }
+}
+
+/// Binds the specified frame buffer for reading and drawing
+void GLStateCache::bind_framebuffer(u32 handle) {
+    if (update(framebuffer, handle)) {
+        glBindFramebuffer(GL_FRAMEBUFFER, handle);
+    }
+}
+
+/// Binds the specified buffer to a target
+void GLStateCache::bind_buffer(u32 target, u32 handle) {
+    auto *cached = target == GL_ARRAY_BUFFER ? &array_buffer
+                   : target == GL_DRAW_INDIRECT_BUFFER ? &indirect_buffer
+                                                       : nullptr;
+    if (not cached) {
+        calls++;
+        glBindBuffer(target, handle);
+    } else if (update(*cached, handle)) {
+        glBindBuffer(target, handle);
+    }
+}
+
+/// Binds the specified buffer to an indexed binding point of a target
+void GLStateCache::bind_buffer_base(u32 target, u32 index, u32 handle) {
+    if (update(target, index, BufferBinding{ handle, 0, 0 })) {
+        glBindBufferBase(target, index, handle);
+    }
+}
+
+/// Binds a range of the specified buffer to an indexed binding point of a target
+void GLStateCache::bind_buffer_range(u32 target, u32 index, u32 handle, usize offset, usize size) {
+    if (update(target, index, BufferBinding{ handle, offset, size })) {
+        glBindBufferRange(target, index, handle, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+    }
+}
+
+/// Binds the specified texture to a texture unit
+void GLStateCache::bind_texture_unit(u32 unit, u32 handle) {
+    if (unit >= TEXTURE_UNITS) {
+        calls++;
+        glBindTextureUnit(unit, handle);
+    } else if (update(textures[unit], handle)) {
+        glBindTextureUnit(unit, handle);
+    }
+}
+
+/// Enables or disables blending
+void GLStateCache::enable_blend(bool enabled) {
+    if (not update(blend, enabled)) {
+        return;
+    }
+    if (enabled) {
+        glEnable(GL_BLEND);
+    } else {
+        glDisable(GL_BLEND);
+    }
+}
+
+/// Sets the blend function
+void GLStateCache::blend_function(u32 source, u32 destination) {
+    // Both factors are set by a single call, hence only one of the updates may count
+    if (blend_source == source and blend_destination == destination) {
+        calls_avoided++;
+        return;
+    }
+    calls++;
+    blend_source = source;
+    blend_destination = destination;
+    glBlendFunc(source, destination);
+}
+
+/// Enables or disables the depth test
+void GLStateCache::enable_depth_test(bool enabled) {
+    if (not update(depth_test, enabled)) {
+        return;
+    }
+    if (enabled) {
+        glEnable(GL_DEPTH_TEST);
+    } else {
+        glDisable(GL_DEPTH_TEST);
+    }
+}
+
+/// Sets the depth comparison function
+void GLStateCache::depth_function(u32 function) {
+    if (update(depth_func, function)) {
+        glDepthFunc(function);
+    }
+}
+
+/// Enables or disables depth writes
+void GLStateCache::depth_mask(bool enabled) {
+    if (update(depth_write, enabled)) {
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    }
+}
+
+/// Sets the viewport
+void GLStateCache::viewport(s32 x, s32 y, s32 width, s32 height) {
+    auto value = glm::ivec4{ x, y, width, height };
+    if (view == value) {
+        calls_avoided++;
+        return;
+    }
+    calls++;
+    view = value;
+    glViewport(x, y, width, height);
+}
+
+/// Forgets the binding of the specified program
+void GLStateCache::release_program(u32 handle) {
+    if (program == handle) {
+        program = UNKNOWN;
+    }
+}
+
+/// Forgets the binding of the specified vertex array
+void GLStateCache::release_vertex_array(u32 handle) {
+    if (vertex_array == handle) {
+        vertex_array = UNKNOWN;
+    }
+}
+
+/// Forgets the binding of the specified frame buffer
+void GLStateCache::release_framebuffer(u32 handle) {
+    if (framebuffer == handle) {
+        framebuffer = UNKNOWN;
+    }
+}
+
+/// Forgets the bindings of the specified buffer
+void GLStateCache::release_buffer(u32 handle) {
+    auto forget = [handle](u32 &cached) {
+        if (cached == handle) {
+            cached = UNKNOWN;
+        }
+    };
+    forget(array_buffer);
+    forget(indirect_buffer);
+    for (auto &binding : storage_buffers) {
+        forget(binding.handle);
+    }
+    for (auto &binding : uniform_buffers) {
+        forget(binding.handle);
+    }
+}
+
+/// Forgets the bindings of the specified texture
+void GLStateCache::release_texture(u32 handle) {
+    std::ranges::replace(textures, handle, UNKNOWN);
+}
+
+/// Updates a cached value
+bool GLStateCache::update(u32 &cached, u32 value) {
+    if (cached == value) {
+        calls_avoided++;
+        return false;
+    }
+    cached = value;
+    calls++;
+    return true;
+}
+
+/// Updates a cached indexed buffer binding
+bool GLStateCache::update(u32 target, u32 index, const BufferBinding &binding) {
+    auto *bindings = target == GL_SHADER_STORAGE_BUFFER ? &storage_buffers
+                     : target == GL_UNIFORM_BUFFER      ? &uniform_buffers
+                                                        : nullptr;
+    if (not bindings or index >= BUFFER_BINDINGS) {
+        calls++;
+        return true;
+    }
+
+    auto &cached = (*bindings)[index];
+    if (cached == binding) {
+        calls_avoided++;
+        return false;
+    }
+    cached = binding;
+    calls++;
+    return true;
+}
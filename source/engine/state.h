@@ -0,0 +1,183 @@
+//
+// MIT License
+//
+// Copyright (c) 2024 Elias Engelbert Plank
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef ENGINE_STATE_H
+#define ENGINE_STATE_H
+
+#include "types.h"
+
+#include <array>
+
+/// A buffer that is bound to an indexed binding point, the range of a whole buffer binding is empty
+struct BufferBinding {
+    u32 handle;
+    usize offset;
+    usize size;
+
+    bool operator==(const BufferBinding &other) const = default;
+};
+
+/// Mirrors the OpenGL state of the context that is current on the calling thread, such that binds and state changes
+/// that would not change anything are skipped, every change has to go through the cache or be followed by a call to
+/// invalidate, otherwise the cache goes out of sync with the context
+struct GLStateCache {
+    /// The value of state that the cache does not know, which never equals any value that is set
+    constexpr static inline u32 UNKNOWN = ~0u;
+    constexpr static inline u32 TEXTURE_UNITS = 64;
+    constexpr static inline u32 BUFFER_BINDINGS = 16;
+
+    u32 program;
+    u32 vertex_array;
+    u32 framebuffer;
+    u32 array_buffer;
+    u32 indirect_buffer;
+    std::array<BufferBinding, BUFFER_BINDINGS> storage_buffers;
+    std::array<BufferBinding, BUFFER_BINDINGS> uniform_buffers;
+    std::array<u32, TEXTURE_UNITS> textures;
+    u32 blend;
+    u32 blend_source;
+    u32 blend_destination;
+    u32 depth_test;
+    u32 depth_func;
+    u32 depth_write;
+    glm::ivec4 view;
+
+    /// The number of calls that were issued and that were skipped, which are reset by the user, e.g. every frame
+    u32 calls;
+    u32 calls_avoided;
+
+    /// Creates a cache that knows none of the state
+    GLStateCache();
+
+    /// Retrieves the cache of the context that is current on the calling thread
+    /// @return The cache
+    static GLStateCache &current();
+
+    /// Forgets all state, such that the next change of every state is issued, which needs to be called after code
+    /// that does not use the cache touched the context
+    void invalidate();
+
+    /// Binds the specified program
+    /// @param handle The program handle
+    void use_program(u32 handle);
+
+    /// Binds the specified vertex array
+    /// @param handle The vertex array handle
+    void bind_vertex_array(u32 handle);
+
+    /// Binds the specified frame buffer for reading and drawing
+    /// @param handle The frame buffer handle
+    void bind_framebuffer(u32 handle);
+
+    /// Binds the specified buffer to a target, only the array and draw indirect targets are cached, as the element
+    /// array binding belongs to the bound vertex array
+    /// @param target The buffer target
+    /// @param handle The buffer handle
+    void bind_buffer(u32 target, u32 handle);
+
+    /// Binds the specified buffer to an indexed binding point of a target, only the shader storage and uniform
+    /// targets are cached
+    /// @param target The buffer target
+    /// @param index The binding point
+    /// @param handle The buffer handle
+    void bind_buffer_base(u32 target, u32 index, u32 handle);
+
+    /// Binds a range of the specified buffer to an indexed binding point of a target, only the shader storage and
+    /// uniform targets are cached
+    /// @param target The buffer target
+    /// @param index The binding point
+    /// @param handle The buffer handle
+    /// @param offset The offset of the range in bytes
+    /// @param size The size of the range in bytes
+    void bind_buffer_range(u32 target, u32 index, u32 handle, usize offset, usize size);
+
+    /// Binds the specified texture to a texture unit
+    /// @param unit The texture unit
+    /// @param handle The texture handle
+    void bind_texture_unit(u32 unit, u32 handle);
+
+    /// Enables or disables blending
+    /// @param enabled A boolean value that indicates whether blending is enabled
+    void enable_blend(bool enabled);
+
+    /// Sets the blend function
+    /// @param source The source factor
+    /// @param destination The destination factor
+    void blend_function(u32 source, u32 destination);
+
+    /// Enables or disables the depth test
+    /// @param enabled A boolean value that indicates whether the depth test is enabled
+    void enable_depth_test(bool enabled);
+
+    /// Sets the depth comparison function
+    /// @param function The comparison function
+    void depth_function(u32 function);
+
+    /// Enables or disables depth writes
+    /// @param enabled A boolean value that indicates whether depth writes are enabled
+    void depth_mask(bool enabled);
+
+    /// Sets the viewport
+    /// @param x The x coordinate of the lower left corner
+    /// @param y The y coordinate of the lower left corner
+    /// @param width The width
+    /// @param height The height
+    void viewport(s32 x, s32 y, s32 width, s32 height);
+
+    /// Forgets the binding of the specified program, which needs to be called when it is deleted, as its name may be
+    /// reused by a new program that is not bound yet
+    /// @param handle The program handle
+    void release_program(u32 handle);
+
+    /// Forgets the binding of the specified vertex array, which needs to be called when it is deleted
+    /// @param handle The vertex array handle
+    void release_vertex_array(u32 handle);
+
+    /// Forgets the binding of the specified frame buffer, which needs to be called when it is deleted
+    /// @param handle The frame buffer handle
+    void release_framebuffer(u32 handle);
+
+    /// Forgets the bindings of the specified buffer, which needs to be called when it is deleted
+    /// @param handle The buffer handle
+    void release_buffer(u32 handle);
+
+    /// Forgets the bindings of the specified texture, which needs to be called when it is deleted
+    /// @param handle The texture handle
+    void release_texture(u32 handle);
+
+private:
+    /// Updates a cached value
+    /// @param cached The cached value
+    /// @param value The new value
+    /// @return A boolean value that indicates whether the value changed and the call needs to be issued
+    bool update(u32 &cached, u32 value);
+
+    /// Updates a cached indexed buffer binding
+    /// @param target The buffer target
+    /// @param index The binding point
+    /// @param binding The new binding
+    /// @return A boolean value that indicates whether the binding changed and the call needs to be issued
+    bool update(u32 target, u32 index, const BufferBinding &binding);
+};
+
+#endif// ENGINE_STATE_H
@@ -22,13 +22,28 @@
 // SOFTWARE.
 
 #include "texture.h"
+#include "job.h"
+#include "state.h"
+#include "watcher.h"
 
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <map>
 #include <stb_image.h>
 
 /// Loads a texture from the given path and uploads it to the gpu
-Texture::Texture(const fs::path &path) : handle(0), width(0), height(0), channels(4) {
+Texture::Texture(const fs::path &path)
+    : path(path),
+      handle(0),
+      width(0),
+      height(0),
+      channels(4),
+      data(nullptr),
+      resident_handle(0) {
     glCreateTextures(GL_TEXTURE_2D, 1, &handle);
-    glBindTextureUnit(0, handle);
+    GLStateCache::current().bind_texture_unit(0, handle);
 
     stbi_set_flip_vertically_on_load(0);
 
@@ -45,20 +60,229 @@ Texture::Texture(const fs::path &path) : handle(0), width(0), height(0), channel
     glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_CLAMP);
     glTextureSubImage2D(handle, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
+
+    if (GLAD_GL_ARB_bindless_texture) {
+        make_resident();
+    }
 }
 
 /// Destroys the specified texture and its data
 Texture::~Texture() {
     free(data);
+    if (resident_handle) {
+        glMakeTextureHandleNonResidentARB(resident_handle);
+    }
+    GLStateCache::current().release_texture(handle);
     glDeleteTextures(1, &handle);
 }
 
 /// Binds the texture to the sampler at the specified slot
 void Texture::bind(u32 slot) const {
-    glBindTextureUnit(slot, handle);
+    GLStateCache::current().bind_texture_unit(slot, handle);
+}
+
+/// Makes the texture resident and creates its bindless handle
+void Texture::make_resident() {
+    if (resident_handle) {
+        return;
+    }
+    resident_handle = glGetTextureHandleARB(handle);
+    glMakeTextureHandleResidentARB(resident_handle);
+}
+
+/// Uploads an image into the texture
+bool Texture::update(const DecodedImage &image) {
+    if (image.width != width or image.height != height) {
+        return false;
+    }
+
+    // The copy of the image data is kept up to date as well
+    std::memcpy(data, image.data, static_cast<usize>(width) * height * 4);
+    glTextureSubImage2D(handle, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    glGenerateTextureMipmap(handle);
+    return true;
+}
+
+/// Reloads the texture once its image changes
+void Texture::watch(AssetWatcher &watcher) {
+    watcher.watch(path, [this]() -> std::function<void()> {
+        auto native_path = path.string();
+        auto image = DecodedImage::load(path);
+        if (not image) {
+            std::fprintf(stderr, "[texture] Cannot decode '%s', keeping the texture.\n", native_path.c_str());
+            return {};
+        }
+        return [this, native_path, image] {
+            if (not update(*image)) {
+                std::fprintf(stderr, "[texture] '%s' changed its dimensions, keeping the texture.\n",
+                             native_path.c_str());
+            }
+        };
+    });
 }
 
 /// Unbinds the currently bound texture at the specified sampler slot
 void Texture::unbind(u32 slot) {
-    glBindTextureUnit(slot, 0);
+    GLStateCache::current().bind_texture_unit(slot, 0);
+}
+
+/// Decodes an image into four channels
+std::shared_ptr<DecodedImage> DecodedImage::load(const fs::path &path) {
+    auto image = DecodedImage{ nullptr, 0, 0, 4 };
+    auto native_path = path.string();
+    image.data = stbi_load(native_path.c_str(), &image.width, &image.height, &image.channels, 4);
+    if (not image.data) {
+        return nullptr;
+    }
+    return { new DecodedImage{ image }, [](DecodedImage *decoded) {
+                stbi_image_free(decoded->data);
+                delete decoded;
+            } };
+}
+
+/// Loads images of identical dimensions into the layers of an array texture and uploads it to the gpu
+TextureArray::TextureArray(const std::vector<fs::path> &paths, JobSystem *jobs)
+    : handle(0),
+      width(0),
+      height(0),
+      layers(static_cast<s32>(paths.size())),
+      resident_handle(0) {
+    stbi_set_flip_vertically_on_load(0);
+
+    // Decoding does not touch the context, hence only the upload has to happen on the calling thread
+    std::vector<DecodedImage> images(paths.size());
+    auto decode = [&](u32 begin, u32 end) {
+        for (auto layer = begin; layer < end; ++layer) {
+            auto &image = images[layer];
+            auto native_path = paths[layer].string();
+            image.data = stbi_load(native_path.c_str(), &image.width, &image.height, &image.channels, 4);
+        }
+    };
+    if (jobs) {
+        jobs->parallel_for(static_cast<u32>(layers), 1, decode);
+    } else {
+        decode(0, static_cast<u32>(layers));
+    }
+
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &handle);
+    for (s32 layer = 0; layer < layers; ++layer) {
+        const auto &image = images[layer];
+        if (not image.data) {
+            assert(false and "[texture] Failed to allocate memory for texture!");
+        }
+
+        // The storage is allocated as soon as the dimensions of the first layer are known
+        if (layer == 0) {
+            width = image.width;
+            height = image.height;
+            auto levels = static_cast<s32>(std::bit_width(static_cast<u32>(std::max(width, height))));
+            glTextureStorage3D(handle, levels, GL_RGBA8, width, height, layers);
+        }
+        if (image.width != width or image.height != height) {
+            assert(false and "[texture] Array texture layers must have identical dimensions!");
+        }
+
+        glTextureSubImage3D(handle, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.data);
+        stbi_image_free(image.data);
+    }
+
+    glTextureParameteri(handle, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(handle, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(handle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glGenerateTextureMipmap(handle);
+
+    if (GLAD_GL_ARB_bindless_texture) {
+        make_resident();
+    }
+}
+
+/// Destroys the specified array texture
+TextureArray::~TextureArray() {
+    if (resident_handle) {
+        glMakeTextureHandleNonResidentARB(resident_handle);
+    }
+    GLStateCache::current().release_texture(handle);
+    glDeleteTextures(1, &handle);
+}
+
+/// Binds the array texture to the sampler at the specified slot
+void TextureArray::bind(u32 slot) const {
+    GLStateCache::current().bind_texture_unit(slot, handle);
+}
+
+/// Makes the array texture resident and creates its bindless handle
+void TextureArray::make_resident() {
+    if (resident_handle) {
+        return;
+    }
+    resident_handle = glGetTextureHandleARB(handle);
+    glMakeTextureHandleResidentARB(resident_handle);
+}
+
+/// Uploads an image into the specified layer
+bool TextureArray::update(s32 layer, const DecodedImage &image) {
+    if (layer < 0 or layer >= layers or image.width != width or image.height != height) {
+        return false;
+    }
+    glTextureSubImage3D(handle, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.data);
+    glGenerateTextureMipmap(handle);
+    return true;
+}
+
+/// Loads the images and packs all images of identical dimensions into the layers of shared array textures
+TexturePack::TexturePack(const std::vector<fs::path> &paths, JobSystem *jobs) {
+    // Group the images by their dimensions, which can be queried without decoding them
+    std::map<std::pair<s32, s32>, std::vector<fs::path>> groups;
+    for (const auto &path : paths) {
+        s32 width;
+        s32 height;
+        s32 channels;
+        auto native_path = path.string();
+        if (not stbi_info(native_path.c_str(), &width, &height, &channels)) {
+            assert(false and "[texture] Failed to read image dimensions!");
+        }
+        groups[{ width, height }].push_back(path);
+    }
+
+    s32 layers_max;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &layers_max);
+
+    for (const auto &[dimensions, group] : groups) {
+        for (usize first = 0; first < group.size(); first += layers_max) {
+            auto last = std::min(group.size(), first + layers_max);
+            std::vector<fs::path> chunk{ group.begin() + first, group.begin() + last };
+            const auto &array = arrays.emplace_back(std::make_unique<TextureArray>(chunk, jobs));
+            for (s32 layer = 0; layer < array->layers; ++layer) {
+                layers[chunk[layer].string()] = TextureLayer{ array.get(), layer };
+            }
+        }
+    }
+}
+
+/// Retrieves the array texture layer that holds the image loaded from the specified path
+const TextureLayer &TexturePack::layer(const fs::path &path) const {
+    return layers.at(path.string());
+}
+
+/// Reloads the images of the pack once they change
+void TexturePack::watch(AssetWatcher &watcher) {
+    for (const auto &entry : layers) {
+        watcher.watch(entry.first, [this, path = entry.first]() -> std::function<void()> {
+            auto image = DecodedImage::load(path);
+            if (not image) {
+                std::fprintf(stderr, "[texture] Cannot decode '%s', keeping its layer.\n", path.c_str());
+                return {};
+            }
+            return [this, path, image] {
+                const auto &target = layers.at(path);
+                for (const auto &array : arrays) {
+                    if (array.get() == target.array and not array->update(target.layer, *image)) {
+                        std::fprintf(stderr, "[texture] '%s' changed its dimensions, keeping its layer.\n",
+                                     path.c_str());
+                    }
+                }
+            };
+        });
+    }
 }
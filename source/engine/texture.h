@@ -26,12 +26,24 @@
 
 #include "types.h"
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct AssetWatcher;
+struct JobSystem;
+
+struct DecodedImage;
+
 struct Texture {
+    fs::path path;
     u32 handle;
     s32 width;
     s32 height;
     s32 channels;
     u8 *data;
+    u64 resident_handle;
 
     Texture() = default;
 
@@ -46,9 +58,91 @@ struct Texture {
     /// @param slot The sampler slot
     void bind(u32 slot) const;
 
+    /// Makes the texture resident and creates its bindless handle, this requires GL_ARB_bindless_texture
+    /// and renders the texture immutable
+    void make_resident();
+
+    /// Uploads an image into the texture, which keeps the storage and the bindless handle of the texture, hence the
+    /// image must have the dimensions of the texture
+    /// @param image The image
+    /// @return A boolean value that indicates whether the image could be uploaded
+    bool update(const DecodedImage &image);
+
+    /// Reloads the texture once its image changes, the image is uploaded into the texture again, hence it has to keep
+    /// its dimensions
+    /// @param watcher The asset watcher, which the texture has to outlive
+    void watch(AssetWatcher &watcher);
+
     /// Unbinds the currently bound texture at the specified sampler slot
     /// @param slot The sampler slot
     static void unbind(u32 slot);
 };
 
+struct DecodedImage {
+    u8 *data;
+    s32 width;
+    s32 height;
+    s32 channels;
+
+    /// Decodes an image into four channels, which does not touch the context and may happen on any thread
+    /// @param path The path to the image file
+    /// @return The decoded image, whose data is freed along with the image, or nullptr if it cannot be decoded
+    static std::shared_ptr<DecodedImage> load(const fs::path &path);
+};
+
+struct TextureArray {
+    u32 handle;
+    s32 width;
+    s32 height;
+    s32 layers;
+    u64 resident_handle;
+
+    /// Loads images of identical dimensions into the layers of an array texture and uploads it to the gpu
+    /// @param paths The paths to the image files, the n-th image is placed into the n-th layer
+    /// @param jobs The job system that decodes the images in parallel, or nullptr to decode them on the calling thread
+    explicit TextureArray(const std::vector<fs::path> &paths, JobSystem *jobs = nullptr);
+
+    /// Destroys the specified array texture
+    ~TextureArray();
+
+    /// Binds the array texture to the sampler at the specified slot
+    /// @param slot The sampler slot
+    void bind(u32 slot) const;
+
+    /// Makes the array texture resident and creates its bindless handle, this requires GL_ARB_bindless_texture
+    void make_resident();
+
+    /// Uploads an image into the specified layer, which keeps the storage and the bindless handle of the array
+    /// texture, hence the image must have the dimensions of the array texture
+    /// @param layer The layer
+    /// @param image The image
+    /// @return A boolean value that indicates whether the image could be uploaded
+    bool update(s32 layer, const DecodedImage &image);
+};
+
+struct TextureLayer {
+    const TextureArray *array;
+    s32 layer;
+};
+
+struct TexturePack {
+    std::vector<std::unique_ptr<TextureArray>> arrays;
+    std::unordered_map<std::string, TextureLayer> layers;
+
+    /// Loads the images and packs all images of identical dimensions into the layers of shared array textures
+    /// @param paths The paths to the image files
+    /// @param jobs The job system that decodes the images in parallel, or nullptr to decode them on the calling thread
+    explicit TexturePack(const std::vector<fs::path> &paths, JobSystem *jobs = nullptr);
+
+    /// Retrieves the array texture layer that holds the image loaded from the specified path
+    /// @param path The path of the image file
+    /// @return The array texture layer
+    const TextureLayer &layer(const fs::path &path) const;
+
+    /// Reloads the images of the pack once they change, images are uploaded into their layers again, hence they
+    /// have to keep their dimensions
+    /// @param watcher The asset watcher, which the texture pack has to outlive
+    void watch(AssetWatcher &watcher);
+};
+
 #endif// ENGINE_TEXTURE_H
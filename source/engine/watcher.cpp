@@ -0,0 +1,151 @@
+//
+// MIT License
+//
+// Copyright (c) 2024 Elias Engelbert Plank
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "watcher.h"
+
+#include <array>
+#include <cstdio>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/// Retrieves the key of an asset path, such that paths that were spelled differently refer to the same asset
+std::string asset_key(const fs::path &path) {
+    return path.lexically_normal().generic_string();
+}
+
+}// namespace
+
+/// Starts watching the specified directory
+AssetWatcher::AssetWatcher(const fs::path &directory)
+    : directory(directory),
+      reloads(),
+      swaps(),
+      mutex(),
+      thread(),
+      descriptor(-1),
+      wake(-1) {
+#ifdef __linux__
+    // Editors either write a file in place or rename a temporary file over it
+    descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (descriptor == -1 or wake == -1 or
+        inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        std::fprintf(stderr, "[watcher] Cannot watch '%s', assets are not reloaded!\n", directory.c_str());
+        return;
+    }
+    thread = std::thread([this] { run(); });
+#endif
+}
+
+/// Stops watching the directory
+AssetWatcher::~AssetWatcher() {
+#ifdef __linux__
+    if (thread.joinable()) {
+        u64 value = 1;
+        (void) ::write(wake, &value, sizeof(value));
+        thread.join();
+    }
+    if (descriptor != -1) {
+        ::close(descriptor);
+    }
+    if (wake != -1) {
+        ::close(wake);
+    }
+#endif
+}
+
+/// Registers a reload for the specified asset
+void AssetWatcher::watch(const fs::path &path, AssetReload reload) {
+    std::lock_guard lock{ mutex };
+    reloads[asset_key(path)].push_back(std::move(reload));
+}
+
+/// Runs the swaps of the assets that were reloaded since the last update
+void AssetWatcher::update() {
+    std::vector<std::function<void()>> pending;
+    {
+        std::lock_guard lock{ mutex };
+        if (swaps.empty()) {
+            return;
+        }
+        pending.swap(swaps);
+    }
+    for (auto &swap : pending) {
+        swap();
+    }
+}
+
+/// Reads the changes of the watched directory until the watcher is stopped
+void AssetWatcher::run() {
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    std::array<pollfd, 2> descriptors{ pollfd{ descriptor, POLLIN, 0 }, pollfd{ wake, POLLIN, 0 } };
+    while (true) {
+        if (poll(descriptors.data(), descriptors.size(), -1) == -1 or descriptors[1].revents & POLLIN) {
+            break;
+        }
+
+        // A single save usually produces several events, hence every asset is reloaded once per read
+        std::unordered_set<std::string> changed;
+        ssize_t length;
+        while ((length = ::read(descriptor, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t offset = 0; offset < length;) {
+                const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                if (event->len > 0) {
+                    changed.insert(asset_key(directory / event->name));
+                }
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            }
+        }
+
+        for (const auto &key : changed) {
+            std::vector<AssetReload> asset_reloads;
+            {
+                std::lock_guard lock{ mutex };
+                if (auto it = reloads.find(key); it != reloads.end()) {
+                    asset_reloads = it->second;
+                }
+            }
+            if (asset_reloads.empty()) {
+                continue;
+            }
+
+            std::fprintf(stdout, "[watcher] Reloading '%s'.\n", key.c_str());
+            for (const auto &reload : asset_reloads) {
+                if (auto swap = reload()) {
+                    std::lock_guard lock{ mutex };
+                    swaps.push_back(std::move(swap));
+                }
+            }
+        }
+    }
+#endif
+}
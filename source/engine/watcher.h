@@ -0,0 +1,73 @@
+//
+// MIT License
+//
+// Copyright (c) 2024 Elias Engelbert Plank
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef ENGINE_WATCHER_H
+#define ENGINE_WATCHER_H
+
+#include "types.h"
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/// Reloads an asset, it runs on the watcher thread such that decoding stays off the render thread, and returns the
+/// swap that runs at the next frame boundary, or an empty function if the asset could not be reloaded
+using AssetReload = std::function<std::function<void()>()>;
+
+/// Watches a directory through inotify and reloads the assets in it once they change, the reloads run in the
+/// background while their swaps run at frame boundaries, on platforms other than linux nothing is ever reloaded
+struct AssetWatcher {
+    fs::path directory;
+    std::unordered_map<std::string, std::vector<AssetReload>> reloads;
+    std::vector<std::function<void()>> swaps;
+    std::mutex mutex;
+    std::thread thread;
+    s32 descriptor;
+    s32 wake;
+
+    /// Starts watching the specified directory
+    /// @param directory The asset directory, files in subdirectories are not watched
+    explicit AssetWatcher(const fs::path &directory = "assets");
+
+    /// Stops watching the directory, pending swaps are discarded
+    ~AssetWatcher();
+
+    /// Registers a reload for the specified asset, an asset may have several reloads, the owner of the reload must
+    /// outlive the watcher
+    /// @param path The path of the asset within the watched directory
+    /// @param reload The reload
+    void watch(const fs::path &path, AssetReload reload);
+
+    /// Runs the swaps of the assets that were reloaded since the last update, this has to be called at a frame
+    /// boundary by the thread that owns the context
+    void update();
+
+private:
+    /// Reads the changes of the watched directory until the watcher is stopped
+    void run();
+};
+
+#endif// ENGINE_WATCHER_H
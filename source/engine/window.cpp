@@ -22,6 +22,7 @@
 // SOFTWARE.
 
 #include "window.h"
+#include "state.h"
 
 namespace {
 
@@ -65,7 +66,7 @@ void glfw_frame_callback(GLFWwindow *handle, s32 width, s32 height) {
     auto *window = static_cast<Window *>(glfwGetWindowUserPointer(handle));
     window->width = width;
     window->height = height;
-    glViewport(0, 0, width, height);
+    GLStateCache::current().viewport(0, 0, width, height);
 }
 
 }// namespace
@@ -21,7 +21,9 @@
 //  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 //  SOFTWARE.
 
+#include "engine/job.h"
 #include "engine/renderer.h"
+#include "engine/watcher.h"
 #include "engine/window.h"
 
 int main(int argc, char **argv) {
@@ -38,12 +40,38 @@ int main(int argc, char **argv) {
     // Configure the clear color of the renderer to be dark grey
     Renderer::clear_color({ 0.15f, 0.15f, 0.15f, 1.0f });
 
-    Texture white_knight{ "assets/wn.png" };
-    Texture white_queen{ "assets/wq.png" };
-    Texture white_rook{ "assets/wr.png" };
+    // Worker threads that help out with decoding assets
+    JobSystem jobs{};
+
+    // Split the vertex expansion of every submission across the workers
+    renderer.jobs = &jobs;
+
+    // Pack the chess pieces into the layers of a single array texture
+    TexturePack pieces{ { "assets/wn.png", "assets/wq.png", "assets/wr.png" }, &jobs };
+    const auto &white_knight = pieces.layer("assets/wn.png");
+    const auto &white_queen = pieces.layer("assets/wq.png");
+    const auto &white_rook = pieces.layer("assets/wr.png");
+
+    // Reload shaders, textures and the font once they change on disk, the watcher is destroyed before the assets it
+    // reloads
+    AssetWatcher watcher{ "assets" };
+    renderer.watch(watcher);
+    pieces.watch(watcher);
+
+    // Retained layer for geometry that rarely changes
+    RenderLayer backdrop{};
+
+    // The opaque backdrop is drawn beneath the pieces anyway, hence the first layer may draw it front to back
+    renderer.set_opaque_layer(0);
+
+    // Rotation of the spinning sprite in radians
+    f32 rotation = 0.0f;
 
     // Continue event loop while the window wants to stay open
     while (not window.should_close()) {
+        // Swap in the assets that were reloaded in the background
+        watcher.update();
+
         // Clear the viewport at the begin of the frame
         Renderer::clear();
 
@@ -54,22 +82,41 @@ int main(int argc, char **argv) {
         QuadExtent red_extent{};
         red_extent.position = { 20.0f, 20.0f };
         red_extent.size = { 50.0f, 50.0f };
-        renderer.draw_quad(red_extent, { 1.0f, 0.0f, 0.0f, 1.0f });
-        renderer.draw_quad(red_extent, white_queen);
 
         QuadExtent green_extent{};
         green_extent.position = { 70.0f, 20.0f };
         green_extent.size = { 50.0f, 50.0f };
-        renderer.draw_quad(green_extent, { 0.0f, 1.0f, 0.0f, 1.0f });
-        renderer.draw_quad(green_extent, white_knight);
 
         QuadExtent blue_extent{};
         blue_extent.position = { 120.0f, 20.0f };
         blue_extent.size = { 50.0f, 50.0f };
-        renderer.draw_quad(blue_extent, { 0.0f, 0.0f, 1.0f, 1.0f });
+
+        // The colored backdrop never changes, hence it is recorded once and drawn from its cached buffers
+        if (backdrop.dirty) {
+            std::array extents{ red_extent, green_extent, blue_extent };
+            std::array colors{ glm::vec4{ 1.0f, 0.0f, 0.0f, 1.0f }, glm::vec4{ 0.0f, 1.0f, 0.0f, 1.0f },
+                               glm::vec4{ 0.0f, 0.0f, 1.0f, 1.0f } };
+            renderer.begin_layer(backdrop);
+            renderer.draw_quads(extents, colors);
+            renderer.end_layer();
+        }
+        renderer.draw_layer(backdrop);
+
+        renderer.draw_quad(red_extent, white_queen);
+        renderer.draw_quad(green_extent, white_knight);
         renderer.draw_quad(blue_extent, white_rook);
 
-        // Draw a sample text
+        // Draw a sprite that spins around its center
+        SpriteExtent spinning_extent{};
+        spinning_extent.position = { 225.0f, 45.0f };
+        spinning_extent.size = { 50.0f, 50.0f };
+        spinning_extent.rotation = rotation;
+        spinning_extent.pivot = { 0.5f, 0.5f };
+        renderer.draw_sprite(spinning_extent, white_knight);
+        rotation += 0.01f;
+
+        // Draw a sample text on a higher layer, such that it is always drawn on top of the quads
+        renderer.set_layer(1);
         TextExtent text_extent{};
         text_extent.position = { 20.0f, 100.0f };
         text_extent.size = GlyphCache::FONT_SIZE;